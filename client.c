@@ -4,12 +4,31 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
 #include "evilwm.h"
 #include "log.h"
 
 #define MAXIMUM_PROPERTY_LENGTH 4096
 
 static int send_xmessage(Window w, Atom a, long x);
+static void kill_hung_client(Client *c);
+static void ping_schedule(unsigned long when);
+
+/* Hung local clients whose connection has been killed, to be sent
+ * SIGKILL if their process is still around a little later */
+struct pid_kill {
+	pid_t pid;
+	unsigned long when;
+};
+static struct list *pid_kills = NULL;
+
+/* With -focusdelay, the window the pointer entered, to be focused once
+ * it has stayed there long enough */
+static Window focus_pending = None;
+static unsigned long focus_time;
 
 /* used all over the place.  return the client that has specified window as
  * either window or parent */
@@ -25,20 +44,64 @@ Client *find_client(Window w) {
 	return NULL;
 }
 
+/* With -park, hidden clients stay mapped and their frames are just moved
+ * out of sight.  Backing store keeps their contents while they're there,
+ * so showing them again needs no repaint. */
 void client_hide(Client *c) {
-	c->ignore_unmap++;  /* Ignore unmap so we don't remove client */
-	XUnmapWindow(dpy, c->parent);
-	set_wm_state(c, IconicState);
+	if (opt_park) {
+		if (!c->parked) {
+			XSetWindowAttributes attr;
+			attr.backing_store = WhenMapped;
+			XChangeWindowAttributes(dpy, c->parent, CWBackingStore, &attr);
+			c->parked = 1;
+			XMoveWindow(dpy, c->parent, frame_x(c), frame_y(c));
+		}
+	} else {
+		c->ignore_unmap++;  /* Ignore unmap so we don't remove client */
+		XUnmapWindow(dpy, c->parent);
+	}
+	client_set_hidden(c, 1);
 }
 
 void client_show(Client *c) {
+	client_map_frame(c);
+	client_set_hidden(c, 0);
+}
+
+/* Map (or unpark) a client's frame without reporting it as shown, as for
+ * clients inside the container of a hidden virtual desktop */
+void client_map_frame(Client *c) {
+	if (c->parked) {
+		c->parked = 0;
+		XMoveWindow(dpy, c->parent, frame_x(c), frame_y(c));
+	}
 	XMapWindow(dpy, c->parent);
-	set_wm_state(c, NormalState);
+}
+
+/* Tell the client (and pagers) whether it's hidden */
+void client_set_hidden(Client *c, int hidden) {
+	set_wm_state(c, hidden ? IconicState : NormalState);
+	if (c->hidden != hidden) {
+		c->hidden = hidden;
+		ewmh_set_net_wm_state(c);
+		if (has_strut(c))
+			update_workarea(c->screen);
+#ifdef COMPOSITE
+		if (c->fullscreen)
+			composite_update_bypass(c->screen);
+#endif
+	}
 }
 
 void client_raise(Client *c) {
 	XRaiseWindow(dpy, c->parent);
 	clients_stacking_order = list_to_tail(clients_stacking_order, c);
+	/* Docks stay under the focused window while it's fullscreen */
+	if (c->is_dock && current && current->fullscreen
+			&& current->screen == c->screen) {
+		XRaiseWindow(dpy, current->parent);
+		clients_stacking_order = list_to_tail(clients_stacking_order, current);
+	}
 	ewmh_set_net_client_list_stacking(c->screen);
 }
 
@@ -80,6 +143,7 @@ void send_config(Client *c) {
 /* Shift client to show border according to window's gravity. */
 void gravitate_border(Client *c, int bw) {
 	int dx = 0, dy = 0;
+	Monitor *m;
 	switch (c->win_gravity) {
 	default:
 	case NorthWestGravity:
@@ -113,38 +177,184 @@ void gravitate_border(Client *c, int bw) {
 		dy = -bw;
 		break;
 	}
-	if (c->x != 0 || c->width != DisplayWidth(dpy, c->screen->screen)) {
+	/* A client filling its monitor in either direction stays there */
+	m = client_monitor(c);
+	if ((c->x != m->x || c->width != m->width)
+			&& (c->x != m->wx || c->width != m->wwidth)) {
 		c->x += dx;
 	}
-	if (c->y != 0 || c->height != DisplayHeight(dpy, c->screen->screen)) {
+	if ((c->y != m->y || c->height != m->height)
+			&& (c->y != m->wy || c->height != m->wheight)) {
 		c->y += dy;
 	}
 }
 
+void client_set_border_colour(Client *c, int active) {
+	unsigned long bpixel;
+	if (c->hung)
+		bpixel = c->screen->hc.pixel;
+	else if (!active)
+		bpixel = c->screen->bg.pixel;
+#ifdef VWM
+	else if (is_fixed(c))
+		bpixel = c->screen->fc.pixel;
+#endif
+	else
+		bpixel = c->screen->fg.pixel;
+	XSetWindowBorder(dpy, c->parent, bpixel);
+}
+
 void select_client(Client *c) {
+	focus_pending = None;
 	if (current)
-		XSetWindowBorder(dpy, current->parent, current->screen->bg.pixel);
+		client_set_border_colour(current, 0);
 	if (c) {
-		unsigned long bpixel;
+		client_set_border_colour(c, 1);
+		client_install_colormaps(c);
+		XSetInputFocus(dpy, c->window, RevertToPointerRoot, CurrentTime);
 #ifdef VWM
-		if (is_fixed(c))
-			bpixel = c->screen->fc.pixel;
-		else
+		set_current_monitor(c->screen, c->monitor);
 #endif
-			bpixel = c->screen->fg.pixel;
-		XSetWindowBorder(dpy, c->parent, bpixel);
-		XInstallColormap(dpy, c->cmap);
-		XSetInputFocus(dpy, c->window, RevertToPointerRoot, CurrentTime);
 	}
 	current = c;
 	ewmh_set_net_active_window(c);
 }
 
+/* Re-read WM_COLORMAP_WINDOWS.  The colormap of each window listed is
+ * kept with it, and kept up to date from ColormapNotify events, so that
+ * installing them on focus needs no round trips. */
+void client_update_colormap_windows(Client *c) {
+	Window *windows;
+	int i, n, top = 0;
+
+	free(c->cmap_windows);
+	free(c->cmaps);
+	c->cmap_windows = NULL;
+	c->cmaps = NULL;
+	c->num_cmaps = 0;
+	if (c->screen->installed_cmap_for == c->window)
+		c->screen->installed_cmap_for = None;
+	if (!XGetWMColormapWindows(dpy, c->window, &windows, &n))
+		return;
+	for (i = 0; i < n; i++) {
+		if (windows[i] == c->window)
+			top = 1;
+	}
+	/* The top-level window comes first if it isn't listed */
+	c->cmap_windows = malloc((n + 1) * sizeof(Window));
+	c->cmaps = malloc((n + 1) * sizeof(Colormap));
+	if (!c->cmap_windows || !c->cmaps) {
+		free(c->cmap_windows);
+		free(c->cmaps);
+		c->cmap_windows = NULL;
+		c->cmaps = NULL;
+		XFree(windows);
+		return;
+	}
+	if (!top) {
+		c->cmap_windows[0] = c->window;
+		c->cmaps[0] = c->cmap;
+		c->num_cmaps = 1;
+	}
+	for (i = 0; i < n; i++) {
+		XWindowAttributes attr;
+		Colormap cmap = c->cmap;
+		if (windows[i] != c->window) {
+			if (!XGetWindowAttributes(dpy, windows[i], &attr))
+				continue;
+			cmap = attr.colormap;
+			/* (Don't override what's selected on another client) */
+			if (!find_client(windows[i]))
+				XSelectInput(dpy, windows[i], ColormapChangeMask);
+		}
+		c->cmap_windows[c->num_cmaps] = windows[i];
+		c->cmaps[c->num_cmaps] = cmap;
+		c->num_cmaps++;
+	}
+	XFree(windows);
+	LOG_DEBUG("client_update_colormap_windows() : %d colormap windows\n", c->num_cmaps);
+}
+
+/* Install the client's colormaps, unless they're what we installed last.
+ * Those listed in WM_COLORMAP_WINDOWS are installed lowest priority first,
+ * so the first listed ends up at the top. */
+void client_install_colormaps(Client *c) {
+	ScreenInfo *s = c->screen;
+	int i;
+
+	if (!c->num_cmaps) {
+		if (c->cmap == s->installed_cmap)
+			return;
+		XInstallColormap(dpy, c->cmap);
+		s->installed_cmap = c->cmap;
+	} else {
+		if (c->cmaps[0] == s->installed_cmap && c->window == s->installed_cmap_for)
+			return;
+		for (i = c->num_cmaps - 1; i >= 0; i--)
+			XInstallColormap(dpy, c->cmaps[i]);
+		s->installed_cmap = c->cmaps[0];
+	}
+	s->installed_cmap_for = c->window;
+}
+
+/* Client whose window, or one of whose WM_COLORMAP_WINDOWS, is w */
+Client *find_colormap_client(Window w) {
+	struct list *iter;
+	int i;
+
+	for (iter = clients_tab_order; iter; iter = iter->next) {
+		Client *c = iter->data;
+		if (w == c->window)
+			return c;
+		for (i = 0; i < c->num_cmaps; i++) {
+			if (w == c->cmap_windows[i])
+				return c;
+		}
+	}
+	return NULL;
+}
+
+/* Focus a client after -focusdelay ms, unless the pointer moves on (or
+ * something else is focused) first.  NULL just cancels. */
+void select_client_later(Client *c) {
+	if (!c || c == current) {
+		focus_pending = None;
+		return;
+	}
+	focus_pending = c->window;
+	focus_time = time_ms() + opt_focusdelay;
+}
+
+/* Milliseconds until a delayed focus is due, or -1 if there isn't one */
+long client_focus_timeout(void) {
+	long timeout;
+	if (focus_pending == None)
+		return -1;
+	timeout = (long)(focus_time - time_ms());
+	return timeout > 0 ? timeout : 0;
+}
+
+void client_focus_check(void) {
+	Client *c;
+	if (focus_pending == None || (long)(time_ms() - focus_time) < 0)
+		return;
+	c = find_client(focus_pending);
+	focus_pending = None;
+	/* It may have gone, or been hidden, in the meantime */
+	if (c && !c->hidden) {
+		select_client(c);
+		ewmh_select_client(c);
+	}
+}
+
 #ifdef VWM
 void client_to_vdesk(Client *c, unsigned int vdesk) {
 	if (valid_vdesk(vdesk)) {
 		c->vdesk = vdesk;
-		if (c->vdesk == c->screen->vdesk || c->vdesk == VDESK_FIXED) {
+		if (has_vdesk_containers(c->screen)) {
+			client_to_container(c, !dock_hidden(c) || c->parked);
+			client_set_hidden(c, !is_fixed(c) && c->vdesk != c->screen->vdesk);
+		} else if (on_visible_vdesk(c)) {
 			client_show(c);
 		} else {
 			client_hide(c);
@@ -155,7 +365,16 @@ void client_to_vdesk(Client *c, unsigned int vdesk) {
 }
 #endif
 
+/* Match any queued event still referring to a recycled frame */
+static Bool is_frame_event(Display *d, XEvent *e, XPointer arg) {
+	Window frame = *(Window *)arg;
+	(void)d;
+	return e->xany.window == frame
+		|| (e->type == UnmapNotify && e->xunmap.window == frame);
+}
+
 void remove_client(Client *c) {
+	Window pooled = None;
 	LOG_ENTER("remove_client(window=%lx, %s)", c->window, c->remove ? "withdrawing" : "wm quitting");
 
 	XGrabServer(dpy);
@@ -182,24 +401,53 @@ void remove_client(Client *c) {
 	gravitate_border(c, c->old_border);
 	c->x -= c->old_border;
 	c->y -= c->old_border;
-	XReparentWindow(dpy, c->window, c->screen->root, c->x, c->y);
-	XSetWindowBorderWidth(dpy, c->window, c->old_border);
+	if (is_frameless(c)) {
+		XWindowChanges wc;
+		wc.x = c->x;
+		wc.y = c->y;
+		wc.border_width = c->old_border;
+		XConfigureWindow(dpy, c->window, CWX|CWY|CWBorderWidth, &wc);
+#ifdef VWM
+		if (c->container != c->screen->root)
+			XReparentWindow(dpy, c->window, c->screen->root, c->x, c->y);
+#endif
+		XUngrabButton(dpy, AnyButton, AnyModifier, c->window);
+	} else {
+		XReparentWindow(dpy, c->window, c->screen->root, c->x, c->y);
+		XSetWindowBorderWidth(dpy, c->window, c->old_border);
+	}
 	XRemoveFromSaveSet(dpy, c->window);
-	if (c->parent)
-		XDestroyWindow(dpy, c->parent);
+	if (c->parent && !is_frameless(c)) {
+		if (frame_pool_put(c->screen, c->parent))
+			pooled = c->parent;
+		else
+			XDestroyWindow(dpy, c->parent);
+	}
 
 	clients_tab_order = list_delete(clients_tab_order, c);
 	clients_mapping_order = list_delete(clients_mapping_order, c);
 	clients_stacking_order = list_delete(clients_stacking_order, c);
+	if (has_strut(c))
+		c->screen->struts = list_delete(c->screen->struts, c);
+	if (c->screen->installed_cmap_for == c->window)
+		c->screen->installed_cmap_for = None;
+	free(c->cmap_windows);
+	free(c->cmaps);
 	/* If the wm is quitting, we'll remove the client list properties
 	 * soon enough, otherwise: */
 	if (c->remove) {
 		ewmh_set_net_client_list(c->screen);
 		ewmh_set_net_client_list_stacking(c->screen);
+		if (has_strut(c))
+			update_workarea(c->screen);
 	}
 
 	if (current == c)
 		current = NULL;  /* an enter event should set this up again */
+#ifdef COMPOSITE
+	if (c->fullscreen)
+		composite_update_bypass(c->screen);
+#endif
 	free(c);
 #ifdef DEBUG
 	{
@@ -213,6 +461,16 @@ void remove_client(Client *c) {
 
 	XUngrabServer(dpy);
 	XSync(dpy, False);
+	/* A recycled frame mustn't have its old events seen as belonging
+	 * to whichever client gets it next */
+	if (pooled != None) {
+		XEvent ev;
+		while (XCheckIfEvent(dpy, &ev, is_frame_event, (XPointer)&pooled)) {
+#ifdef COMPOSITE
+			composite_handle_event(&ev);
+#endif
+		}
+	}
 	ignore_xerror = 0;
 	LOG_LEAVE();
 }
@@ -227,10 +485,166 @@ void send_wm_delete(Client *c, int kill_client) {
 				found++;
 		XFree(protocols);
 	}
-	if (found)
+	if (found) {
 		send_xmessage(c->window, xa_wm_protos, xa_wm_delete);
-	else
+		/* Ping to see if it's still alive to act on the request.  If
+		 * it's still hung after -killdelay, it gets killed. */
+		client_ping(c);
+		if (opt_killdelay && c->ping_sent && !c->kill_time) {
+			unsigned long delay = opt_killdelay * 1000;
+			if (delay < PING_TIMEOUT)
+				delay = PING_TIMEOUT;
+			c->kill_time = time_ms() + delay;
+			ping_schedule(c->kill_time);
+		}
+	} else if (c->hung) {
+		kill_hung_client(c);
+	} else {
 		XKillClient(dpy, c->window);
+	}
+}
+
+/* Kill a client that isn't answering pings.  XKillClient only closes its
+ * connection, so if it's running on this host and its process is still
+ * there shortly afterwards, that's sent SIGKILL. */
+static void kill_hung_client(Client *c) {
+	XTextProperty machine;
+	char hostname[256];
+	unsigned long pid = ewmh_get_net_wm_pid(c);
+	int local = 0;
+
+	if (pid > 0 && XGetWMClientMachine(dpy, c->window, &machine)) {
+		if (machine.value && gethostname(hostname, sizeof(hostname)) == 0) {
+			hostname[sizeof(hostname)-1] = 0;
+			local = (0 == strcmp((char *)machine.value, hostname));
+		}
+		if (machine.value)
+			XFree(machine.value);
+	}
+	XKillClient(dpy, c->window);
+	if (local) {
+		struct pid_kill *pk = malloc(sizeof(struct pid_kill));
+		if (pk) {
+			pk->pid = (pid_t)pid;
+			pk->when = time_ms() + PING_TIMEOUT;
+			pid_kills = list_prepend(pid_kills, pk);
+			ping_schedule(pk->when);
+		}
+	}
+}
+
+/* Processes still running PING_TIMEOUT after their connection was killed
+ * are sent SIGKILL */
+static void check_pid_kills(unsigned long now) {
+	struct list *iter, *niter;
+
+	for (iter = pid_kills; iter; iter = niter) {
+		struct pid_kill *pk = iter->data;
+		niter = iter->next;
+		if ((long)(now - pk->when) < 0) {
+			ping_schedule(pk->when);
+			continue;
+		}
+		if (kill(pk->pid, 0) == 0) {
+			LOG_DEBUG("check_pid_kills() : SIGKILL to pid %lu\n", (unsigned long)pk->pid);
+			kill(pk->pid, SIGKILL);
+		}
+		pid_kills = list_delete(pid_kills, pk);
+		free(pk);
+	}
+}
+
+/* _NET_WM_PING watchdog.  Every deadline (unanswered pings, pending kills
+ * and the next round of -ping) is folded into one, so the event loop only
+ * has to look at clients when something is actually due. */
+
+static unsigned long ping_deadline = 0;  /* 0 if nothing pending */
+static unsigned long next_ping_round = 0;
+
+static void ping_schedule(unsigned long when) {
+	if (!ping_deadline || (long)(when - ping_deadline) < 0)
+		ping_deadline = when;
+}
+
+/* Ping a client unless it has a ping outstanding already */
+void client_ping(Client *c) {
+	if (!c->ping_protocol || c->ping_sent)
+		return;
+	c->ping_sent = time_ms() | 1;  /* never 0 */
+	/* The ping carries server time, not ours */
+	ewmh_send_net_wm_ping(c, last_event_time);
+	ping_schedule(c->ping_sent + PING_TIMEOUT);
+}
+
+void client_ping_reply(Client *c) {
+	if (!c->ping_sent)
+		return;
+	c->ping_sent = 0;
+	c->kill_time = 0;
+	if (c->hung) {
+		LOG_DEBUG("client_ping_reply() : %lx responding again\n", c->window);
+		c->hung = 0;
+		client_set_border_colour(c, c == current);
+	}
+}
+
+/* Milliseconds until client_ping_check() has something to do, or -1 to
+ * wait indefinitely */
+long client_ping_timeout(void) {
+	long timeout;
+	if (opt_ping && !next_ping_round) {
+		next_ping_round = time_ms() + opt_ping * 1000;
+		ping_schedule(next_ping_round);
+	}
+	if (!ping_deadline)
+		return -1;
+	timeout = (long)(ping_deadline - time_ms());
+	return timeout > 0 ? timeout : 0;
+}
+
+void client_ping_check(void) {
+	unsigned long now;
+	struct list *iter, *niter;
+	int round = 0;
+
+	if (!ping_deadline)
+		return;
+	now = time_ms();
+	if ((long)(now - ping_deadline) < 0)
+		return;
+	ping_deadline = 0;
+	if (!opt_ping) {
+		next_ping_round = 0;
+	} else if ((long)(now - next_ping_round) >= 0) {
+		next_ping_round = now + opt_ping * 1000;
+		round = 1;
+	}
+	for (iter = clients_tab_order; iter; iter = niter) {
+		Client *c = iter->data;
+		niter = iter->next;
+		if (c->ping_sent && !c->hung
+				&& (long)(now - (c->ping_sent + PING_TIMEOUT)) >= 0) {
+			LOG_DEBUG("client_ping_check() : %lx not responding\n", c->window);
+			c->hung = 1;
+			client_set_border_colour(c, c == current);
+		}
+		if (c->kill_time) {
+			if ((long)(now - c->kill_time) >= 0) {
+				c->kill_time = 0;
+				if (c->hung)
+					kill_hung_client(c);
+			} else {
+				ping_schedule(c->kill_time);
+			}
+		}
+		if (round)
+			client_ping(c);
+		if (c->ping_sent && !c->hung)
+			ping_schedule(c->ping_sent + PING_TIMEOUT);
+	}
+	check_pid_kills(now);
+	if (next_ping_round)
+		ping_schedule(next_ping_round);
 }
 
 static int send_xmessage(Window w, Atom a, long x) {
@@ -251,7 +665,7 @@ void set_shape(Client *c) {
 	int bounding_shaped;
 	int i, b;  unsigned int u;  /* dummies */
 
-	if (!have_shape) return;
+	if (!have_shape || is_frameless(c)) return;
 	/* Logic to decide if we have a shaped window cribbed from fvwm-2.5.10.
 	 * Previous method (more than one rectangle returned from
 	 * XShapeGetRectangles) worked _most_ of the time. */
@@ -260,6 +674,9 @@ void set_shape(Client *c) {
 		LOG_DEBUG("%d shape extents\n", bounding_shaped);
 		XShapeCombineShape(dpy, c->parent, ShapeBounding, 0, 0,
 				c->window, ShapeBounding, ShapeSet);
+#ifdef COMPOSITE
+		composite_shape_changed(c->parent);
+#endif
 	}
 }
 #endif
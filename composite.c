@@ -0,0 +1,514 @@
+/* evilwm - Minimalist Window Manager for X
+ * Copyright (C) 1999-2015 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+/* Optional built-in compositing.  Every top level window is redirected
+ * offscreen, so the server keeps each window's contents and moving or
+ * unmapping one never exposes (and makes redraw) the windows underneath.
+ * Areas reported by the Damage extension are repainted with XRender into a
+ * back buffer, top window first, and copied from there to the composite
+ * overlay window.  Only core Render operations are used, so this works as
+ * well on a framebuffer-only server like Xvfb as on accelerated hardware.
+ *
+ * Windows are treated as opaque: there's no translucency or shadows. */
+
+#ifdef COMPOSITE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <X11/extensions/shape.h>
+#include "evilwm.h"
+#include "log.h"
+
+/* A top level window as seen by the compositor */
+struct cwin {
+	Window id;
+	ScreenInfo *screen;
+	int x, y, width, height, border;
+	int viewable;
+	int damaged;  /* contents reported since last mapped */
+	int input_only;
+	XRenderPictFormat *format;
+	Picture picture;
+	Damage damage;
+	XserverRegion border_size;  /* bounding region in root coordinates */
+};
+
+static struct list *cwins = NULL;  /* bottom of stack first */
+static Atom xa_xrootpmap_id;
+
+static void update_buffer(ScreenInfo *s);
+
+static struct cwin *find_cwin(Window w) {
+	struct list *iter;
+	for (iter = cwins; iter; iter = iter->next) {
+		struct cwin *cw = iter->data;
+		if (cw->id == w)
+			return cw;
+	}
+	return NULL;
+}
+
+static ScreenInfo *find_composited_screen(Window root) {
+	int i;
+	for (i = 0; i < num_screens; i++) {
+		if (screens[i].root == root && screens[i].overlay != None)
+			return &screens[i];
+	}
+	return NULL;
+}
+
+/* Takes ownership of region */
+static void add_damage(ScreenInfo *s, XserverRegion region) {
+	if (s->damage == None) {
+		s->damage = region;
+	} else {
+		XFixesUnionRegion(dpy, s->damage, s->damage, region);
+		XFixesDestroyRegion(dpy, region);
+	}
+}
+
+static void damage_screen(ScreenInfo *s) {
+	XRectangle r;
+	r.x = r.y = 0;
+	r.width = s->buffer_width;
+	r.height = s->buffer_height;
+	add_damage(s, XFixesCreateRegion(dpy, &r, 1));
+}
+
+static XserverRegion cwin_extents(struct cwin *cw) {
+	XRectangle r;
+	r.x = cw->x;
+	r.y = cw->y;
+	r.width = cw->width + 2 * cw->border;
+	r.height = cw->height + 2 * cw->border;
+	return XFixesCreateRegion(dpy, &r, 1);
+}
+
+static void damage_cwin(struct cwin *cw) {
+	if (cw->viewable && !cw->input_only)
+		add_damage(cw->screen, cwin_extents(cw));
+}
+
+static void free_border_size(struct cwin *cw) {
+	if (cw->border_size != None) {
+		XFixesDestroyRegion(dpy, cw->border_size);
+		cw->border_size = None;
+	}
+}
+
+static void add_cwin(ScreenInfo *s, Window w) {
+	XWindowAttributes attr;
+	struct cwin *cw;
+
+	if (w == s->overlay || find_cwin(w))
+		return;
+	if (!XGetWindowAttributes(dpy, w, &attr))
+		return;
+	cw = malloc(sizeof(struct cwin));
+	if (!cw)
+		return;
+	cw->id = w;
+	cw->screen = s;
+	cw->x = attr.x;
+	cw->y = attr.y;
+	cw->width = attr.width;
+	cw->height = attr.height;
+	cw->border = attr.border_width;
+	cw->viewable = (attr.map_state == IsViewable);
+	/* Contents are kept when an already mapped window is redirected */
+	cw->damaged = cw->viewable;
+	cw->input_only = (attr.class == InputOnly);
+	cw->format = NULL;
+	cw->picture = None;
+	cw->damage = None;
+	cw->border_size = None;
+	if (!cw->input_only) {
+		cw->format = XRenderFindVisualFormat(dpy, attr.visual);
+		cw->damage = XDamageCreate(dpy, w, XDamageReportNonEmpty);
+	}
+	cwins = list_append(cwins, cw);
+}
+
+/* If the window still exists, its Damage object has to be freed too */
+static void remove_cwin(struct cwin *cw, int destroyed) {
+	damage_cwin(cw);
+	if (cw->picture != None)
+		XRenderFreePicture(dpy, cw->picture);
+	if (cw->damage != None && !destroyed)
+		XDamageDestroy(dpy, cw->damage);
+	free_border_size(cw);
+	cwins = list_delete(cwins, cw);
+	free(cw);
+}
+
+/* Put cw directly above the window "above", or at the bottom if None */
+static void restack_cwin(struct cwin *cw, Window above) {
+	struct list *iter;
+	cwins = list_delete(cwins, cw);
+	if (above == None) {
+		cwins = list_prepend(cwins, cw);
+		return;
+	}
+	for (iter = cwins; iter; iter = iter->next) {
+		struct cwin *below = iter->data;
+		if (below->id == above) {
+			cwins = list_insert_before(cwins, iter->next, cw);
+			return;
+		}
+	}
+	cwins = list_append(cwins, cw);
+}
+
+void composite_init_screen(ScreenInfo *s) {
+	char name[20];
+	Atom cm_selection;
+	XRenderPictFormat *format;
+	XRenderPictureAttributes pa;
+	XWindowAttributes attr;
+	XserverRegion region;
+	Window dw1, dw2, *wins;
+	unsigned int i, nwins;
+
+	s->overlay = None;
+	s->damage = None;
+	s->bypassed = 0;
+	if (!opt_composite || !have_composite)
+		return;
+
+	/* Don't fight with another compositing manager */
+	snprintf(name, sizeof(name), "_NET_WM_CM_S%d", s->screen);
+	cm_selection = XInternAtom(dpy, name, False);
+	if (XGetSelectionOwner(dpy, cm_selection) != None) {
+		LOG_ERROR("screen %d is already composited, not compositing\n", s->screen);
+		return;
+	}
+	XSetSelectionOwner(dpy, cm_selection, s->supporting, CurrentTime);
+	xa_xrootpmap_id = XInternAtom(dpy, "_XROOTPMAP_ID", False);
+
+	LOG_ENTER("composite_init_screen(screen=%d)", s->screen);
+	XGrabServer(dpy);
+	XCompositeRedirectSubwindows(dpy, s->root, CompositeRedirectManual);
+
+	/* The overlay must not take input from the windows it shows */
+	s->overlay = XCompositeGetOverlayWindow(dpy, s->root);
+	region = XFixesCreateRegion(dpy, NULL, 0);
+	XFixesSetWindowShapeRegion(dpy, s->overlay, ShapeInput, 0, 0, region);
+	XFixesDestroyRegion(dpy, region);
+
+	format = XRenderFindVisualFormat(dpy, DefaultVisual(dpy, s->screen));
+	pa.subwindow_mode = IncludeInferiors;
+	s->root_picture = XRenderCreatePicture(dpy, s->overlay, format, CPSubwindowMode, &pa);
+	s->root_buffer = None;
+	s->root_tile = None;
+	s->buffer_width = s->buffer_height = 0;
+
+	/* Wallpaper setters announce changes on the root window */
+	XGetWindowAttributes(dpy, s->root, &attr);
+	XSelectInput(dpy, s->root, attr.your_event_mask | PropertyChangeMask);
+
+	XQueryTree(dpy, s->root, &dw1, &dw2, &wins, &nwins);
+	for (i = 0; i < nwins; i++)
+		add_cwin(s, wins[i]);
+	if (wins)
+		XFree(wins);
+	XUngrabServer(dpy);
+	update_buffer(s);
+	composite_update_bypass(s);
+	LOG_DEBUG("%d windows\n", nwins);
+	LOG_LEAVE();
+}
+
+void composite_deinit_screen(ScreenInfo *s) {
+	struct list *iter, *niter;
+	if (s->overlay == None)
+		return;
+	for (iter = cwins; iter; iter = niter) {
+		struct cwin *cw = iter->data;
+		niter = iter->next;
+		if (cw->screen == s)
+			remove_cwin(cw, 0);
+	}
+	if (s->damage != None)
+		XFixesDestroyRegion(dpy, s->damage);
+	if (s->root_tile != None)
+		XRenderFreePicture(dpy, s->root_tile);
+	if (s->root_buffer != None)
+		XRenderFreePicture(dpy, s->root_buffer);
+	XRenderFreePicture(dpy, s->root_picture);
+	XCompositeReleaseOverlayWindow(dpy, s->root);
+	if (!s->bypassed)
+		XCompositeUnredirectSubwindows(dpy, s->root, CompositeRedirectManual);
+	s->overlay = None;
+	s->bypassed = 0;
+	s->damage = None;
+}
+
+/* The back buffer follows the size of the screen, which may be changed
+ * through RandR */
+static void update_buffer(ScreenInfo *s) {
+	XRenderPictFormat *format;
+	Pixmap pixmap;
+	int width = DisplayWidth(dpy, s->screen);
+	int height = DisplayHeight(dpy, s->screen);
+
+	if (s->root_buffer != None && width == s->buffer_width && height == s->buffer_height)
+		return;
+	if (s->root_buffer != None)
+		XRenderFreePicture(dpy, s->root_buffer);
+	format = XRenderFindVisualFormat(dpy, DefaultVisual(dpy, s->screen));
+	pixmap = XCreatePixmap(dpy, s->root, width, height, DefaultDepth(dpy, s->screen));
+	s->root_buffer = XRenderCreatePicture(dpy, pixmap, format, 0, NULL);
+	XFreePixmap(dpy, pixmap);
+	s->buffer_width = width;
+	s->buffer_height = height;
+	damage_screen(s);
+}
+
+static Picture get_root_tile(ScreenInfo *s) {
+	XRenderPictureAttributes pa;
+	unsigned long n;
+	Pixmap *pixmap;
+	XRenderColor black = { 0, 0, 0, 0xffff };
+
+	if (s->root_tile != None)
+		return s->root_tile;
+	pixmap = get_property(s->root, xa_xrootpmap_id, XA_PIXMAP, &n);
+	if (pixmap && n > 0 && *pixmap != None) {
+		pa.repeat = True;
+		s->root_tile = XRenderCreatePicture(dpy, *pixmap,
+				XRenderFindVisualFormat(dpy, DefaultVisual(dpy, s->screen)),
+				CPRepeat, &pa);
+	} else {
+		s->root_tile = XRenderCreateSolidFill(dpy, &black);
+	}
+	if (pixmap)
+		XFree(pixmap);
+	return s->root_tile;
+}
+
+static void paint_screen(ScreenInfo *s) {
+	struct list *iter;
+	struct cwin **stack;
+	XserverRegion region, clip;
+	int i, n = 0;
+
+	update_buffer(s);
+	region = s->damage;
+	s->damage = None;
+
+	for (iter = cwins; iter; iter = iter->next)
+		n++;
+	stack = malloc(n * sizeof(struct cwin *));
+	if (!stack && n > 0) {
+		XFixesDestroyRegion(dpy, region);
+		return;
+	}
+	n = 0;
+	for (iter = cwins; iter; iter = iter->next)
+		stack[n++] = iter->data;
+
+	/* Top down, each window paints what's left of the damaged area
+	 * within its bounds, and then takes that away */
+	clip = XFixesCreateRegion(dpy, NULL, 0);
+	for (i = n - 1; i >= 0; i--) {
+		struct cwin *cw = stack[i];
+		if (cw->screen != s || !cw->viewable || cw->input_only || !cw->damaged || !cw->format)
+			continue;
+		if (cw->picture == None) {
+			XRenderPictureAttributes pa;
+			pa.subwindow_mode = IncludeInferiors;
+			cw->picture = XRenderCreatePicture(dpy, cw->id, cw->format, CPSubwindowMode, &pa);
+		}
+		if (cw->border_size == None) {
+			cw->border_size = XFixesCreateRegionFromWindow(dpy, cw->id, WindowRegionBounding);
+			XFixesTranslateRegion(dpy, cw->border_size, cw->x + cw->border, cw->y + cw->border);
+		}
+		XFixesIntersectRegion(dpy, clip, region, cw->border_size);
+		XFixesSetPictureClipRegion(dpy, s->root_buffer, 0, 0, clip);
+		XRenderComposite(dpy, PictOpSrc, cw->picture, None, s->root_buffer,
+				0, 0, 0, 0, cw->x, cw->y,
+				cw->width + 2 * cw->border, cw->height + 2 * cw->border);
+		XFixesSubtractRegion(dpy, region, region, cw->border_size);
+	}
+	free(stack);
+	XFixesDestroyRegion(dpy, clip);
+
+	/* Whatever is left shows the root background */
+	XFixesSetPictureClipRegion(dpy, s->root_buffer, 0, 0, region);
+	XRenderComposite(dpy, PictOpSrc, get_root_tile(s), None, s->root_buffer,
+			0, 0, 0, 0, 0, 0, s->buffer_width, s->buffer_height);
+	XFixesSetPictureClipRegion(dpy, s->root_buffer, 0, 0, None);
+	XFixesDestroyRegion(dpy, region);
+
+	XRenderComposite(dpy, PictOpSrc, s->root_buffer, None, s->root_picture,
+			0, 0, 0, 0, 0, 0, s->buffer_width, s->buffer_height);
+}
+
+/* Copying the whole buffer to the overlay is cheap next to repainting
+ * windows, and saves keeping a copy of the damage region */
+void composite_paint(void) {
+	int i;
+	for (i = 0; i < num_screens; i++) {
+		if (screens[i].overlay != None && screens[i].damage != None
+				&& !screens[i].bypassed)
+			paint_screen(&screens[i]);
+	}
+}
+
+/* Events the compositor can take from the queue while the window manager is
+ * busy with something else (e.g., a drag).  UnmapNotify isn't included, as
+ * the window manager needs to see those itself. */
+int is_composite_event(XEvent *ev) {
+	if (!have_composite)
+		return 0;
+	switch (ev->type) {
+	case CreateNotify:
+	case DestroyNotify:
+	case ConfigureNotify:
+	case MapNotify:
+	case ReparentNotify:
+	case CirculateNotify:
+		return find_composited_screen(ev->xany.window) != NULL;
+	default:
+		return ev->type == damage_event_base + XDamageNotify;
+	}
+}
+
+void composite_handle_event(XEvent *ev) {
+	ScreenInfo *s;
+	struct cwin *cw;
+
+	if (!have_composite)
+		return;
+	if (ev->type == damage_event_base + XDamageNotify) {
+		XDamageNotifyEvent *de = (XDamageNotifyEvent *)ev;
+		XserverRegion parts;
+		if (!(cw = find_cwin(de->drawable)))
+			return;
+		if (!cw->damaged) {
+			/* First contents since being mapped: show it all */
+			cw->damaged = 1;
+			XDamageSubtract(dpy, cw->damage, None, None);
+			damage_cwin(cw);
+			return;
+		}
+		parts = XFixesCreateRegion(dpy, NULL, 0);
+		XDamageSubtract(dpy, cw->damage, None, parts);
+		XFixesTranslateRegion(dpy, parts, cw->x + cw->border, cw->y + cw->border);
+		add_damage(cw->screen, parts);
+		return;
+	}
+	if (ev->type == PropertyNotify) {
+		if (ev->xproperty.atom == xa_xrootpmap_id
+				&& (s = find_composited_screen(ev->xproperty.window))) {
+			if (s->root_tile != None) {
+				XRenderFreePicture(dpy, s->root_tile);
+				s->root_tile = None;
+			}
+			damage_screen(s);
+		}
+		return;
+	}
+	if (!(s = find_composited_screen(ev->xany.window)))
+		return;
+	switch (ev->type) {
+	case CreateNotify:
+		add_cwin(s, ev->xcreatewindow.window);
+		break;
+	case DestroyNotify:
+		if ((cw = find_cwin(ev->xdestroywindow.window)))
+			remove_cwin(cw, 1);
+		break;
+	case ReparentNotify:
+		if (ev->xreparent.parent == s->root)
+			add_cwin(s, ev->xreparent.window);
+		else if ((cw = find_cwin(ev->xreparent.window)))
+			remove_cwin(cw, 0);
+		break;
+	case MapNotify:
+		if ((cw = find_cwin(ev->xmap.window))) {
+			cw->viewable = 1;
+			cw->damaged = 0;
+		}
+		break;
+	case UnmapNotify:
+		if ((cw = find_cwin(ev->xunmap.window))) {
+			damage_cwin(cw);
+			cw->viewable = 0;
+			free_border_size(cw);
+		}
+		break;
+	case ConfigureNotify:
+		if (!(cw = find_cwin(ev->xconfigure.window)))
+			break;
+		damage_cwin(cw);
+		cw->x = ev->xconfigure.x;
+		cw->y = ev->xconfigure.y;
+		cw->width = ev->xconfigure.width;
+		cw->height = ev->xconfigure.height;
+		cw->border = ev->xconfigure.border_width;
+		free_border_size(cw);
+		restack_cwin(cw, ev->xconfigure.above);
+		damage_cwin(cw);
+		break;
+	case CirculateNotify:
+		if ((cw = find_cwin(ev->xcirculate.window))) {
+			if (ev->xcirculate.place == PlaceOnTop)
+				cwins = list_to_tail(cwins, cw);
+			else
+				cwins = list_to_head(cwins, cw);
+			damage_cwin(cw);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/* While a visible fullscreen client hasn't asked to be composited
+ * (_NET_WM_BYPASS_COMPOSITOR of 2), the screen is unredirected and the
+ * overlay given an empty shape, so the client draws straight to the
+ * screen.  Window tracking carries on, and everything is repainted once
+ * compositing resumes. */
+void composite_update_bypass(ScreenInfo *s) {
+	struct list *iter;
+	int bypass = 0;
+	XserverRegion region;
+
+	if (s->overlay == None)
+		return;
+	for (iter = clients_tab_order; iter; iter = iter->next) {
+		Client *c = iter->data;
+		if (c->screen == s && c->fullscreen && !c->hidden
+				&& c->bypass_compositor != 2) {
+			bypass = 1;
+			break;
+		}
+	}
+	if (bypass == s->bypassed)
+		return;
+	LOG_DEBUG("screen %d: compositing %s\n", s->screen, bypass ? "suspended" : "resumed");
+	s->bypassed = bypass;
+	if (bypass) {
+		region = XFixesCreateRegion(dpy, NULL, 0);
+		XFixesSetWindowShapeRegion(dpy, s->overlay, ShapeBounding, 0, 0, region);
+		XFixesDestroyRegion(dpy, region);
+		XCompositeUnredirectSubwindows(dpy, s->root, CompositeRedirectManual);
+	} else {
+		XCompositeRedirectSubwindows(dpy, s->root, CompositeRedirectManual);
+		XFixesSetWindowShapeRegion(dpy, s->overlay, ShapeBounding, 0, 0, None);
+		damage_screen(s);
+	}
+}
+
+/* Frames are reshaped without a ConfigureNotify */
+void composite_shape_changed(Window w) {
+	struct cwin *cw = find_cwin(w);
+	if (!cw)
+		return;
+	damage_cwin(cw);
+	free_border_size(cw);
+}
+
+#endif  /* def COMPOSITE */
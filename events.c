@@ -10,7 +10,8 @@
 #include "evilwm.h"
 #include "log.h"
 
-static int interruptibleXNextEvent(XEvent *event);
+static int interruptibleXNextEvent(XEvent *event, long timeout);
+static long next_timeout(void);
 
 #ifdef DEBUG
 const char *debug_atom_name(Atom a);
@@ -23,26 +24,120 @@ const char *debug_atom_name(Atom a) {
 }
 #endif
 
+/* Auto-repeats of a move or resize key that have already arrived are
+ * taken off the queue and applied as one bigger step.  Returns the number
+ * of presses, and updates e->time to that of the last one. */
+static int coalesce_key_repeats(XKeyEvent *e) {
+	XEvent next;
+	int n = 1;
+	while (XEventsQueued(dpy, QueuedAfterReading) > 0) {
+		XPeekEvent(dpy, &next);
+		if ((next.type != KeyPress && next.type != KeyRelease)
+				|| next.xkey.keycode != e->keycode
+				|| next.xkey.state != e->state)
+			break;
+		XNextEvent(dpy, &next);
+		if (next.type == KeyPress) {
+			n++;
+			e->time = next.xkey.time;
+		}
+	}
+	return n;
+}
+
+/* Keyboard move (or with altmask, resize) by one step per key press,
+ * accelerating while the key is held if -keyaccel is given */
+static void key_step(Client *c, XKeyEvent *e, KeySym key, int dx, int dy) {
+	static KeySym held_key = NoSymbol;
+	static Time held_time;
+	static int held = 0;
+	Time start = e->time;
+	int width_inc = (c->width_inc > 1) ? c->width_inc : 16;
+	int height_inc = (c->height_inc > 1) ? c->height_inc : 16;
+	int presses = coalesce_key_repeats(e);
+	int steps = presses;
+	int i;
+
+	if (key == held_key && start - held_time < KEY_ACCEL_GAP)
+		held += presses;
+	else
+		held = 0;
+	held_key = key;
+	held_time = e->time;
+	if (opt_keyaccel) {
+		int factor = 1 + held / KEY_ACCEL_STEPS;
+		steps *= (factor < KEY_ACCEL_MAX) ? factor : KEY_ACCEL_MAX;
+	}
+	LOG_DEBUG("key_step: %d presses, %d steps\n", presses, steps);
+
+	if (!(e->state & altmask)) {
+		c->x += dx * 16 * steps;
+		c->y += dy * 16 * steps;
+		return;
+	}
+	for (i = 0; i < steps; i++) {
+		if (dx < 0 && (c->width - width_inc) >= c->min_width)
+			c->width -= width_inc;
+		if (dx > 0 && (!c->max_width || (c->width + width_inc) <= c->max_width))
+			c->width += width_inc;
+		if (dy < 0 && (c->height - height_inc) >= c->min_height)
+			c->height -= height_inc;
+		if (dy > 0 && (!c->max_height || (c->height + height_inc) <= c->max_height))
+			c->height += height_inc;
+	}
+}
+
 static void handle_key_event(XKeyEvent *e) {
 	KeySym key = XkbKeycodeToKeysym(dpy, e->keycode, 0, 0);
 	Client *c;
-	int width_inc, height_inc;
-	ScreenInfo *current_screen = find_current_screen();
+	Monitor *m;
+	ScreenInfo *current_screen;
+
+	/* The key event tells us where the pointer is, which saves a round
+	 * trip for anything after this that needs the current screen.  If
+	 * it's on another screen, its position here is meaningless. */
+	if (e->same_screen)
+		note_pointer_position(e->root, e->x_root, e->y_root);
+	else
+		forget_pointer_screen();
+	current_screen = find_current_screen();
+#ifdef VWM
+	/* Desktop keys act on the monitor under the pointer */
+	{
+		int x, y;
+		get_pointer_position(current_screen, &x, &y);
+		set_current_monitor(current_screen,
+				find_monitor(current_screen, x, y)
+				- current_screen->monitors);
+	}
+#endif
 
 	switch(key) {
 		case KEY_NEW:
 			spawn((const char *const *)opt_term);
 			break;
 		case KEY_NEXT:
-			next();
-			if (XGrabKeyboard(dpy, e->root, False, GrabModeAsync, GrabModeAsync, CurrentTime) == GrabSuccess) {
-				XEvent ev;
-				do {
-					XMaskEvent(dpy, KeyPressMask|KeyReleaseMask, &ev);
-					if (ev.type == KeyPress && XkbKeycodeToKeysym(dpy, ev.xkey.keycode, 0, 0) == KEY_NEXT)
-						next();
-				} while (ev.type == KeyPress || XkbKeycodeToKeysym(dpy, ev.xkey.keycode, 0, 0) == KEY_NEXT);
-				XUngrabKeyboard(dpy, CurrentTime);
+			{
+				Client *highlighted = NULL;
+				if (opt_cyclehighlight)
+					highlighted = highlight_next(NULL);
+				else
+					next();
+				if (XGrabKeyboard(dpy, e->root, False, GrabModeAsync, GrabModeAsync, CurrentTime) == GrabSuccess) {
+					XEvent ev;
+					do {
+						XMaskEvent(dpy, KeyPressMask|KeyReleaseMask, &ev);
+						if (ev.type == KeyPress && XkbKeycodeToKeysym(dpy, ev.xkey.keycode, 0, 0) == KEY_NEXT) {
+							if (opt_cyclehighlight)
+								highlighted = highlight_next(highlighted);
+							else
+								next();
+						}
+					} while (ev.type == KeyPress || XkbKeycodeToKeysym(dpy, ev.xkey.keycode, 0, 0) == KEY_NEXT);
+					XUngrabKeyboard(dpy, CurrentTime);
+				}
+				if (opt_cyclehighlight)
+					highlight_commit(highlighted);
 			}
 			ewmh_select_client(current);
 			break;
@@ -74,59 +169,41 @@ static void handle_key_event(XKeyEvent *e) {
 	}
 	c = current;
 	if (c == NULL) return;
-	width_inc = (c->width_inc > 1) ? c->width_inc : 16;
-	height_inc = (c->height_inc > 1) ? c->height_inc : 16;
 	switch (key) {
 		case KEY_LEFT:
-			if (e->state & altmask) {
-				if ((c->width - width_inc) >= c->min_width)
-					c->width -= width_inc;
-			} else {
-				c->x -= 16;
-			}
+			key_step(c, e, key, -1, 0);
 			goto move_client;
 		case KEY_DOWN:
-			if (e->state & altmask) {
-				if (!c->max_height || (c->height + height_inc) <= c->max_height)
-					c->height += height_inc;
-			} else {
-				c->y += 16;
-			}
+			key_step(c, e, key, 0, 1);
 			goto move_client;
 		case KEY_UP:
-			if (e->state & altmask) {
-				if ((c->height - height_inc) >= c->min_height)
-					c->height -= height_inc;
-			} else {
-				c->y -= 16;
-			}
+			key_step(c, e, key, 0, -1);
 			goto move_client;
 		case KEY_RIGHT:
-			if (e->state & altmask) {
-				if (!c->max_width || (c->width + width_inc) <= c->max_width)
-					c->width += width_inc;
-			} else {
-				c->x += 16;
-			}
+			key_step(c, e, key, 1, 0);
 			goto move_client;
 		case KEY_TOPLEFT:
-			c->x = c->border;
-			c->y = c->border;
+			m = client_monitor(c);
+			c->x = m->x + c->border;
+			c->y = m->y + c->border;
 			goto move_client;
 		case KEY_TOPRIGHT:
-			c->x = DisplayWidth(dpy, c->screen->screen)
+			m = client_monitor(c);
+			c->x = m->x + m->width
 				- c->width-c->border;
-			c->y = c->border;
+			c->y = m->y + c->border;
 			goto move_client;
 		case KEY_BOTTOMLEFT:
-			c->x = c->border;
-			c->y = DisplayHeight(dpy, c->screen->screen)
+			m = client_monitor(c);
+			c->x = m->x + c->border;
+			c->y = m->y + m->height
 				- c->height-c->border;
 			goto move_client;
 		case KEY_BOTTOMRIGHT:
-			c->x = DisplayWidth(dpy, c->screen->screen)
+			m = client_monitor(c);
+			c->x = m->x + m->width
 				- c->width-c->border;
-			c->y = DisplayHeight(dpy, c->screen->screen)
+			c->y = m->y + m->height
 				- c->height-c->border;
 			goto move_client;
 		case KEY_KILL:
@@ -147,7 +224,7 @@ static void handle_key_event(XKeyEvent *e) {
 #ifdef VWM
 		case KEY_FIX:
 			if (is_fixed(c)) {
-				client_to_vdesk(c, current_screen->vdesk);
+				client_to_vdesk(c, monitor_vdesk(c->screen, c->monitor));
 			} else {
 				client_to_vdesk(c, VDESK_FIXED);
 			}
@@ -161,18 +238,43 @@ move_client:
 		c->x = 0;
 	if (abs(c->y) == c->border && c->oldh != 0)
 		c->y = 0;
+	ignore_enter_events_begin();
 	moveresize(c);
 #ifdef WARP_POINTER
 	setmouse(c->window, c->width + c->border - 1,
 			c->height + c->border - 1);
 #endif
-	discard_enter_events(c);
+	ignore_enter_events_end(c);
 	return;
 }
 
 static void handle_button_event(XButtonEvent *e) {
 	Client *c = find_client(e->window);
 
+	/* Grabbed on the root: act on the client under the pointer */
+	if (!c && e->subwindow != None) {
+		c = find_client(e->subwindow);
+#ifdef VWM
+		/* Frames inside a vdesk container are a level further down */
+		if (!c) {
+			Window child;
+			int x, y;
+			if (XTranslateCoordinates(dpy, e->root, e->subwindow,
+						e->x_root, e->y_root, &x, &y, &child)
+					&& child != None)
+				c = find_client(child);
+		}
+#endif
+	}
+	/* The root grab froze the pointer.  A click on anything else (the
+	 * bare root, an override-redirect popup) is passed on. */
+	if (e->window == e->root)
+		XAllowEvents(dpy, c ? AsyncPointer : ReplayPointer, e->time);
+
+	if (e->same_screen)
+		note_pointer_position(e->root, e->x_root, e->y_root);
+	else
+		forget_pointer_screen();
 	if (c) {
 		switch (e->button) {
 			case Button1:
@@ -255,11 +357,12 @@ static void do_window_changes(int value_mask, XWindowChanges *wc, Client *c,
 			gravitate_border(c, c->border);
 		}
 	}
-	wc->x = c->x - c->border;
-	wc->y = c->y - c->border;
+	wc->x = frame_x(c);
+	wc->y = frame_y(c);
 	wc->border_width = c->border;
 	XConfigureWindow(dpy, c->parent, value_mask, wc);
-	XMoveResizeWindow(dpy, c->window, 0, 0, c->width, c->height);
+	if (!is_frameless(c))
+		XMoveResizeWindow(dpy, c->window, 0, 0, c->width, c->height);
 	if ((value_mask & (CWX|CWY)) && !(value_mask & (CWWidth|CWHeight))) {
 		send_config(c);
 	}
@@ -300,8 +403,10 @@ static void handle_map_request(XMapRequestEvent *e) {
 	LOG_ENTER("handle_map_request(window=%lx)", e->window);
 	if (c) {
 #ifdef VWM
-		if (!is_fixed(c) && c->vdesk != c->screen->vdesk)
+		if (!on_visible_vdesk(c)) {
+			set_current_monitor(c->screen, c->monitor);
 			switch_vdesk(c->screen, c->vdesk);
+		}
 #endif
 		client_show(c);
 		client_raise(c);
@@ -333,11 +438,26 @@ static void handle_unmap_event(XUnmapEvent *e) {
 }
 
 static void handle_colormap_change(XColormapEvent *e) {
-	Client *c = find_client(e->window);
+	Client *c = find_colormap_client(e->window);
+	int i;
 
-	if (c && e->new) {
-		c->cmap = e->colormap;
-		XInstallColormap(dpy, c->cmap);
+	if (!c)
+		return;
+	if (e->new) {
+		if (e->window == c->window)
+			c->cmap = e->colormap;
+		for (i = 0; i < c->num_cmaps; i++) {
+			if (e->window == c->cmap_windows[i])
+				c->cmaps[i] = e->colormap;
+		}
+		if (c->screen->installed_cmap_for == c->window)
+			c->screen->installed_cmap_for = None;
+		if (c == current)
+			client_install_colormaps(c);
+	} else if (e->state == ColormapUninstalled
+			&& e->colormap == c->screen->installed_cmap) {
+		/* Someone else installed over ours */
+		c->screen->installed_cmap = None;
 	}
 }
 
@@ -349,11 +469,26 @@ static void handle_property_change(XPropertyEvent *e) {
 		if (e->atom == XA_WM_NORMAL_HINTS) {
 			get_wm_normal_hints(c);
 			LOG_DEBUG("geometry=%dx%d+%d+%d\n", c->width, c->height, c->x, c->y);
+		} else if (e->atom == xa_net_wm_strut_partial
+				|| e->atom == xa_net_wm_strut) {
+			client_update_strut(c);
+		} else if (e->atom == xa_wm_cmapwins) {
+			client_update_colormap_windows(c);
+			if (c == current)
+				client_install_colormaps(c);
+		} else if (e->atom == xa_wm_protos) {
+			c->ping_protocol = ewmh_get_net_wm_ping(c);
+		} else if (e->atom == xa_net_wm_bypass_compositor) {
+			c->bypass_compositor = ewmh_get_net_wm_bypass_compositor(c);
+#ifdef COMPOSITE
+			if (c->fullscreen)
+				composite_update_bypass(c->screen);
+#endif
 		} else if (e->atom == xa_net_wm_window_type) {
 			get_window_type(c);
 			if (!c->is_dock
 #ifdef VWM
-					&& (is_fixed(c) || (c->vdesk == c->screen->vdesk))
+					&& on_visible_vdesk(c)
 #endif
 					) {
 				client_show(c);
@@ -366,24 +501,51 @@ static void handle_property_change(XPropertyEvent *e) {
 static void handle_enter_event(XCrossingEvent *e) {
 	Client *c;
 
-	if ((c = find_client(e->window))) {
+	if (e->same_screen)
+		note_pointer_position(e->root, e->x_root, e->y_root);
+	else
+		forget_pointer_screen();
+	if (is_ignored_enter(e)) {
+		LOG_DEBUG("ignoring enter caused by our own changes\n");
+		return;
+	}
+	c = find_client(e->window);
 #ifdef VWM
-		if (!is_fixed(c) && c->vdesk != c->screen->vdesk)
-			return;
+	if (c && !on_visible_vdesk(c))
+		c = NULL;
 #endif
+	if (opt_focusdelay) {
+		/* Entering anything else, even the root, cancels a pending
+		 * focus: only the window the pointer settles on gets it */
+		select_client_later(c);
+	} else if (c) {
 		select_client(c);
 		ewmh_select_client(c);
 	}
 }
 
+static void handle_leave_event(XCrossingEvent *e) {
+	/* Only selected on root windows: if the pointer is no longer on
+	 * the same screen, the next EnterNotify will tell us where it went */
+	if (!e->same_screen)
+		forget_pointer_screen();
+}
+
 static void handle_mappingnotify_event(XMappingEvent *e) {
+	int i;
 	XRefreshKeyboardMapping(e);
 	if (e->request == MappingKeyboard) {
-		int i;
 		for (i = 0; i < num_screens; i++) {
 			grab_keys_for_screen(&screens[i]);
 		}
 	}
+	/* Grabs include NumLock variants, so redo them if that moved */
+	if (e->request == MappingModifier && update_numlockmask()) {
+		for (i = 0; i < num_screens; i++) {
+			grab_keys_for_screen(&screens[i]);
+		}
+		regrab_buttons();
+	}
 }
 
 #ifdef SHAPE
@@ -402,6 +564,15 @@ static void handle_client_message(XClientMessageEvent *e) {
 
 	LOG_ENTER("handle_client_message(window=%lx, format=%d, type=%s)", e->window, e->format, debug_atom_name(e->message_type));
 
+	/* Ping replies are sent to the root window */
+	if (e->message_type == xa_wm_protos
+			&& (Atom)e->data.l[0] == xa_net_wm_ping) {
+		c = find_client(e->data.l[2]);
+		if (c)
+			client_ping_reply(c);
+		LOG_LEAVE();
+		return;
+	}
 #ifdef VWM
 	if (e->message_type == xa_net_current_desktop) {
 		switch_vdesk(s, e->data.l[0]);
@@ -486,7 +657,7 @@ static void handle_client_message(XClientMessageEvent *e) {
 			} else if ((Atom)e->data.l[i] == xa_net_wm_state_maximized_horz) {
 				maximise_hv |= MAXIMISE_HORZ;
 			} else if ((Atom)e->data.l[i] == xa_net_wm_state_fullscreen) {
-				maximise_hv |= MAXIMISE_VERT|MAXIMISE_HORZ;
+				fullscreen_client(c, e->data.l[0]);
 			}
 		}
 		if (maximise_hv) {
@@ -495,9 +666,37 @@ static void handle_client_message(XClientMessageEvent *e) {
 		LOG_LEAVE();
 		return;
 	}
+	if (e->message_type == xa_net_wm_fullscreen_monitors) {
+		set_fullscreen_monitors(c, e->data.l);
+		LOG_LEAVE();
+		return;
+	}
 	LOG_LEAVE();
 }
 
+/* Server time of the latest event that carried one, for requests that
+ * want a real timestamp */
+Time last_event_time = CurrentTime;
+
+static void note_event_time(XEvent *ev) {
+	switch (ev->type) {
+		case KeyPress:
+		case KeyRelease:
+			last_event_time = ev->xkey.time; break;
+		case ButtonPress:
+		case ButtonRelease:
+			last_event_time = ev->xbutton.time; break;
+		case MotionNotify:
+			last_event_time = ev->xmotion.time; break;
+		case EnterNotify:
+		case LeaveNotify:
+			last_event_time = ev->xcrossing.time; break;
+		case PropertyNotify:
+			last_event_time = ev->xproperty.time; break;
+		default: break;
+	}
+}
+
 void event_main_loop(void) {
 	union {
 		XEvent xevent;
@@ -507,7 +706,19 @@ void event_main_loop(void) {
 	} ev;
 	/* main event loop here */
 	while (!wm_exit) {
-		if (interruptibleXNextEvent(&ev.xevent)) {
+#ifdef COMPOSITE
+		/* Repaint only once there's nothing more to update */
+		if (!XPending(dpy))
+			composite_paint();
+#endif
+		/* The pointer may have moved since the last event, so only
+		 * the screen it was on is kept */
+		forget_pointer_position();
+		if (interruptibleXNextEvent(&ev.xevent, next_timeout())) {
+			note_event_time(&ev.xevent);
+#ifdef COMPOSITE
+			composite_handle_event(&ev.xevent);
+#endif
 			switch (ev.xevent.type) {
 			case KeyPress:
 				handle_key_event(&ev.xevent.xkey); break;
@@ -521,6 +732,8 @@ void event_main_loop(void) {
 				handle_colormap_change(&ev.xevent.xcolormap); break;
 			case EnterNotify:
 				handle_enter_event(&ev.xevent.xcrossing); break;
+			case LeaveNotify:
+				handle_leave_event(&ev.xevent.xcrossing); break;
 			case PropertyNotify:
 				handle_property_change(&ev.xevent.xproperty); break;
 			case UnmapNotify:
@@ -537,12 +750,29 @@ void event_main_loop(void) {
 #endif
 #ifdef RANDR
 				if (have_randr && ev.xevent.type == randr_event_base + RRScreenChangeNotify) {
+					ScreenInfo *s = find_screen(((XRRScreenChangeNotifyEvent *)&ev.xevent)->root);
 					XRRUpdateConfiguration(&ev.xevent);
+					if (s) {
+						Monitor old[MAX_MONITORS];
+						int num_old = s->num_monitors;
+						memcpy(old, s->monitors, sizeof(old));
+						update_monitors(s);
+						relayout_screen(s, old, num_old);
+#ifdef VWM
+						vdesk_containers_resize(s);
+#endif
+					}
 				}
 #endif
 				break;
 			}
 		}
+		client_ping_check();
+		client_focus_check();
+		if (wm_reload) {
+			wm_reload = 0;
+			reload_config();
+		}
 		if (need_client_tidy) {
 			struct list *iter, *niter;
 			need_client_tidy = 0;
@@ -556,6 +786,15 @@ void event_main_loop(void) {
 	}
 }
 
+/* Milliseconds until the next timer is due, or -1 if none are pending */
+static long next_timeout(void) {
+	long timeout = client_ping_timeout();
+	long focus = client_focus_timeout();
+	if (focus >= 0 && (timeout < 0 || focus < timeout))
+		timeout = focus;
+	return timeout;
+}
+
 /* interruptibleXNextEvent() is taken from the Blender source and comes with
  * the following copyright notice: */
 
@@ -566,10 +805,12 @@ void event_main_loop(void) {
  * implied. This program is -not- in the public domain. */
 
 /* Unlike XNextEvent, if a signal arrives, interruptibleXNextEvent will
- * return zero. */
+ * return zero.  It also returns zero if no event arrives within timeout
+ * milliseconds (negative to wait indefinitely). */
 
-static int interruptibleXNextEvent(XEvent *event) {
+static int interruptibleXNextEvent(XEvent *event, long timeout) {
 	fd_set fds;
+	struct timeval tv;
 	int rc;
 	int dpy_fd = ConnectionNumber(dpy);
 	for (;;) {
@@ -579,7 +820,11 @@ static int interruptibleXNextEvent(XEvent *event) {
 		}
 		FD_ZERO(&fds);
 		FD_SET(dpy_fd, &fds);
-		rc = select(dpy_fd + 1, &fds, NULL, NULL, NULL);
+		tv.tv_sec = timeout / 1000;
+		tv.tv_usec = (timeout % 1000) * 1000;
+		rc = select(dpy_fd + 1, &fds, NULL, NULL, timeout < 0 ? NULL : &tv);
+		if (rc == 0)
+			return 0;
 		if (rc < 0) {
 			if (errno == EINTR) {
 				return 0;
@@ -11,9 +11,24 @@
 #ifdef SHAPE
 #include <X11/extensions/shape.h>
 #endif
+#ifdef SYNC
+#include <X11/extensions/sync.h>
+#endif
+#ifdef XINPUT2
+#include <X11/extensions/XInput2.h>
+#endif
 #ifdef RANDR
 #include <X11/extensions/Xrandr.h>
 #endif
+#ifdef XINERAMA
+#include <X11/extensions/Xinerama.h>
+#endif
+#ifdef COMPOSITE
+#include <X11/extensions/Xcomposite.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+#include <X11/extensions/Xrender.h>
+#endif
 
 #ifndef __GNUC__
 # define  __attribute__(x)
@@ -46,6 +61,16 @@ typedef struct {
 #define DEF_BG          "grey50"
 #define DEF_BW          1
 #define DEF_FC          "blue"
+#define DEF_HC          "red"
+#define DEF_FRAMEPOOL   4
+#define DEF_DRAGRATE    60   /* Hz, if refresh rate can't be found */
+#define CONFIG_INTERVAL 100  /* ms between ConfigureNotifys in a drag */
+#define SYNC_TIMEOUT    500  /* ms to wait for a client's sync counter */
+#define PING_TIMEOUT    2000 /* ms before an unanswered ping marks a client hung */
+#define KEY_ACCEL_GAP   250  /* ms between presses still counted as held */
+#define KEY_ACCEL_STEPS 8    /* held presses per extra step with -keyaccel */
+#define KEY_ACCEL_MAX   4    /* most steps per press with -keyaccel */
+#define HIGHLIGHT_WIDTH 3    /* width of the -cyclehighlight overlay */
 #define SPACE           3
 #ifdef DEBIAN
 #define DEF_TERM        "x-terminal-emulator"
@@ -83,50 +108,97 @@ typedef struct {
 #define ChildMask       (SubstructureRedirectMask|SubstructureNotifyMask)
 #define ButtonMask      (ButtonPressMask|ButtonReleaseMask)
 #define MouseMask       (ButtonMask|PointerMotionMask)
+#define FrameEventMask  (ChildMask|ButtonPressMask|EnterWindowMask)
+#define ClientEventMask (ColormapChangeMask|EnterWindowMask|PropertyChangeMask)
 
 #define grab_pointer(w, mask, curs) \
 	(XGrabPointer(dpy, w, False, mask, GrabModeAsync, GrabModeAsync, \
 	None, curs, CurrentTime) == GrabSuccess)
-#define grab_button(w, mask, button) do { \
+#define grab_button(w, mask, button) \
+	grab_button_mode(w, mask, button, GrabModeAsync)
+#define grab_button_mode(w, mask, button, pmode) do { \
 		XGrabButton(dpy, button, (mask), w, False, ButtonMask, \
-		            GrabModeAsync, GrabModeSync, None, None); \
+		            pmode, GrabModeSync, None, None); \
 		XGrabButton(dpy, button, LockMask|(mask), w, False, ButtonMask,\
-		            GrabModeAsync, GrabModeSync, None, None); \
+		            pmode, GrabModeSync, None, None); \
 		XGrabButton(dpy, button, numlockmask|(mask), w, False, \
-		            ButtonMask, GrabModeAsync, GrabModeSync, \
+		            ButtonMask, pmode, GrabModeSync, \
 		            None, None); \
 		XGrabButton(dpy, button, numlockmask|LockMask|(mask), w, False,\
-		            ButtonMask, GrabModeAsync, GrabModeSync, \
+		            ButtonMask, pmode, GrabModeSync, \
 		            None, None); \
 	} while (0)
-#define setmouse(w, x, y) XWarpPointer(dpy, None, w, 0, 0, 0, 0, x, y)
-#define get_mouse_position(xp,yp,root) do { \
-		Window dw; \
-		int di; \
-		unsigned int dui; \
-		XQueryPointer(dpy, root, &dw, &dw, xp, yp, &di, &di, &dui); \
+#define setmouse(w, x, y) do { \
+		XWarpPointer(dpy, None, w, 0, 0, 0, 0, x, y); \
+		forget_pointer_position(); \
 	} while (0)
 
 #define is_fixed(c) (c->vdesk == VDESK_FIXED)
+#define has_vdesk_containers(s) ((s)->vdesk_container[0] != None)
+#define monitor_vdesk(s, i) (opt_monitordesks ? (s)->monitors[i].vdesk : (s)->vdesk)
+#define on_visible_vdesk(c) (is_fixed(c) || c->vdesk == monitor_vdesk(c->screen, c->monitor))
+#define dock_hidden(c) (c->is_dock && !c->screen->docks_visible)
+#define has_strut(c) (c->strut[0] || c->strut[1] || c->strut[2] || c->strut[3])
 #define add_fixed(c) c->vdesk = VDESK_FIXED
 #define remove_fixed(c) c->vdesk = c->screen->vdesk
+/* Frameless clients are managed directly, with no reparenting frame */
+#define is_frameless(c) (c->parent == c->window)
+/* Frame x position, off the left of the screen while parked */
+#define frame_x(c) (c->parked ? -(c->width + 2*c->border) : c->x - c->border)
+#define frame_y(c) (c->y - c->border)
 
 /* screen structure */
 
+/* monitor geometry, relative to the root window */
+
+#define MAX_MONITORS 16
+
+typedef struct Monitor Monitor;
+struct Monitor {
+	int x, y, width, height;
+	int wx, wy, wwidth, wheight;  /* work area, less any struts */
+	int refresh;  /* refresh rate in Hz, 0 until first looked up */
+#ifdef VWM
+	unsigned int vdesk, old_vdesk;  /* only used with -monitordesks */
+#endif
+};
+
 typedef struct ScreenInfo ScreenInfo;
 struct ScreenInfo {
 	int screen;
 	Window root;
 	Window supporting;  /* Dummy window for EWMH */
 	GC invert_gc;
-	XColor fg, bg;
+	XColor fg, bg, hc;
 #ifdef VWM
 	unsigned int vdesk;
 	XColor fc;
 	unsigned old_vdesk; /* most recently unmapped vdesk, so user may toggle back to it */
+	Window vdesk_container[VDESK_MAX + 1];  /* all None without -containers */
 #endif
 	char *display;
 	int docks_visible;
+	Window *frame_pool;  /* spare frames, ready for reuse */
+	int frame_pool_size, frame_pool_count;
+	Window *client_list, *client_list_stacking;  /* as last set on root */
+	int client_list_count, client_list_stacking_count;
+	int client_list_size, client_list_stacking_size;
+	struct list *struts;  /* clients reserving space at the screen edges */
+	Colormap installed_cmap;  /* last one we installed, None if unknown */
+	Window installed_cmap_for;  /* client it was installed for */
+	Monitor monitors[MAX_MONITORS];  /* always at least one */
+	int num_monitors;
+	int last_monitor;  /* index of the last one found by find_monitor() */
+#ifdef VWM
+	int current_monitor;  /* with -monitordesks, the one vdesk is for */
+#endif
+#ifdef COMPOSITE
+	Window overlay;  /* None if not compositing this screen */
+	int bypassed;  /* compositing suspended for a fullscreen window */
+	Picture root_picture, root_buffer, root_tile;
+	int buffer_width, buffer_height;
+	XserverRegion damage;  /* None if nothing to repaint */
+#endif
 };
 
 /* client structure */
@@ -137,11 +209,23 @@ struct Client {
 	Window  parent;
 	ScreenInfo      *screen;
 	Colormap        cmap;
+	Window          *cmap_windows;  /* from WM_COLORMAP_WINDOWS, or NULL */
+	Colormap        *cmaps;  /* colormap of each of those windows */
+	int             num_cmaps;
 	int             ignore_unmap;
 
 	int             x, y, width, height;
 	int             border;
 	int             oldx, oldy, oldw, oldh;  /* used when maximising */
+	int             fullscreen;
+	int             fs_oldx, fs_oldy, fs_oldw, fs_oldh, fs_oldborder;
+	int             fs_monitors[4];  /* top, bottom, left, right; -1 for the client's own */
+	int             bypass_compositor;  /* _NET_WM_BYPASS_COMPOSITOR value */
+	int             strut[12];  /* as _NET_WM_STRUT_PARTIAL, all 0 if none */
+	int             ping_protocol;  /* answers _NET_WM_PING */
+	unsigned long   ping_sent;  /* time_ms() of unanswered ping, or 0 */
+	unsigned long   kill_time;  /* time_ms() to kill if still hung, or 0 */
+	int             hung;  /* ping went unanswered */
 
 	int             min_width, min_height;
 	int             max_width, max_height;
@@ -152,8 +236,12 @@ struct Client {
 	int             old_border;
 #ifdef VWM
 	unsigned int vdesk;
+	Window          container;  /* parent of the frame */
+	int             monitor;  /* index of the monitor it's on */
 #endif
 	int             is_dock;
+	int             hidden;  /* by client_hide() */
+	int             parked;  /* hidden by moving the frame out of sight */
 	int             remove;  /* set when client needs to be removed */
 };
 
@@ -182,8 +270,20 @@ extern ScreenInfo   *screens;
 #ifdef SHAPE
 extern int          have_shape, shape_event;
 #endif
+#ifdef SYNC
+extern int          have_sync, sync_event_base;
+#endif
+#ifdef XINPUT2
+extern int          have_xi2, have_xi2_raw, xi2_opcode;
+#endif
 #ifdef RANDR
-extern int          have_randr, randr_event_base;
+extern int          have_randr, randr_event_base, have_randr_monitors;
+#endif
+#ifdef XINERAMA
+extern int          have_xinerama;
+#endif
+#ifdef COMPOSITE
+extern int          have_composite, damage_event_base;
 #endif
 
 /* Standard X protocol atoms */
@@ -221,8 +321,15 @@ extern Atom xa_net_wm_state;
 extern Atom xa_net_wm_state_maximized_vert;
 extern Atom xa_net_wm_state_maximized_horz;
 extern Atom xa_net_wm_state_fullscreen;
+extern Atom xa_net_wm_fullscreen_monitors;
+extern Atom xa_net_wm_bypass_compositor;
+extern Atom xa_net_wm_strut;
+extern Atom xa_net_wm_strut_partial;
 extern Atom xa_net_frame_extents;
 
+/* EWMH: Window Manager Protocols */
+extern Atom xa_net_wm_ping;
+
 /* Things that affect user interaction */
 extern unsigned int     numlockmask;
 extern unsigned int     grabmask1;
@@ -231,6 +338,24 @@ extern unsigned int     altmask;
 extern char             **opt_term;
 extern int              opt_bw;
 extern int              opt_snap;
+extern int              opt_framepool;
+extern int              opt_frameless;
+extern int              opt_dragrate;
+extern int              opt_solidsweep;
+extern int              opt_rootgrabs;
+extern int              opt_keyaccel;
+extern int              opt_cyclehighlight;
+extern int              opt_park;
+extern int              opt_ping;
+extern int              opt_killdelay;
+extern int              opt_focusdelay;
+#ifdef VWM
+extern int              opt_containers;
+extern int              opt_monitordesks;
+#endif
+#ifdef COMPOSITE
+extern int              opt_composite;
+#endif
 #ifdef SOLIDDRAG
 extern int              no_solid_drag;
 #else
@@ -247,28 +372,60 @@ extern volatile Window  initialising;
 
 /* Event loop will run until this flag is set */
 extern int wm_exit;
+/* Set alongside wm_exit to restart in place */
+extern int wm_restart;
+/* Set to re-read configuration at the next opportunity */
+extern int wm_reload;
+void reload_config(void);
+int update_numlockmask(void);
 
 /* client.c */
 
 Client *find_client(Window w);
 void client_hide(Client *c);
 void client_show(Client *c);
+void client_map_frame(Client *c);
+void client_set_hidden(Client *c, int hidden);
 void client_raise(Client *c);
 void client_lower(Client *c);
 void gravitate_border(Client *c, int bw);
+void client_set_border_colour(Client *c, int active);
 void select_client(Client *c);
+void client_update_colormap_windows(Client *c);
+void client_install_colormaps(Client *c);
+Client *find_colormap_client(Window w);
+void select_client_later(Client *c);
+long client_focus_timeout(void);
+void client_focus_check(void);
 #ifdef VWM
 void client_to_vdesk(Client *c, unsigned int vdesk);
 #endif
 void remove_client(Client *c);
 void send_config(Client *c);
 void send_wm_delete(Client *c, int kill_client);
+void client_ping(Client *c);
+void client_ping_reply(Client *c);
+long client_ping_timeout(void);
+void client_ping_check(void);
 void set_wm_state(Client *c, int state);
 void set_shape(Client *c);
 void *get_property(Window w, Atom property, Atom req_type, unsigned long *nitems_return);
 
+/* composite.c */
+
+#ifdef COMPOSITE
+void composite_init_screen(ScreenInfo *s);
+void composite_deinit_screen(ScreenInfo *s);
+void composite_paint(void);
+int is_composite_event(XEvent *ev);
+void composite_handle_event(XEvent *ev);
+void composite_shape_changed(Window w);
+void composite_update_bypass(ScreenInfo *s);
+#endif
+
 /* events.c */
 
+extern Time last_event_time;
 void event_main_loop(void);
 
 /* misc.c */
@@ -279,40 +436,91 @@ int handle_xerror(Display *dsply, XErrorEvent *e);
 void spawn(const char *const cmd[]);
 void handle_signal(int signo);
 void discard_enter_events(Client *except);
+void ignore_enter_events_begin(void);
+void ignore_enter_events_end(Client *except);
+int is_ignored_enter(XCrossingEvent *e);
+unsigned long time_ms(void);
+int wait_for_x(long timeout);
 
 /* new.c */
 
 void make_new_client(Window w, ScreenInfo *s);
 long get_wm_normal_hints(Client *c);
 void get_window_type(Client *c);
+void frame_pool_init(ScreenInfo *s);
+void frame_pool_deinit(ScreenInfo *s);
+int frame_pool_put(ScreenInfo *s, Window frame);
+
+/* restart.c */
+
+int restart_save(void);
+void restart_exec(char *const argv[]);
+void restart_load(void);
+void restart_restore_screen(ScreenInfo *s);
+void restart_restore_finish(void);
 
 /* screen.c */
 
 void drag(Client *c);
 void moveresize(Client *c);
 void maximise_client(Client *c, int action, int hv);
+void fullscreen_client(Client *c, int action);
+void set_fullscreen_monitors(Client *c, const long *monitors);
 void show_info(Client *c, unsigned int keycode);
 void sweep(Client *c);
 void next(void);
+Client *highlight_next(Client *from);
+void highlight_commit(Client *c);
 #ifdef VWM
 void switch_vdesk(ScreenInfo *s, unsigned int v);
+void vdesk_containers_init(ScreenInfo *s);
+void vdesk_containers_deinit(ScreenInfo *s);
+void vdesk_containers_resize(ScreenInfo *s);
+void client_to_container(Client *c, int mapped);
+void desktop_to_container(ScreenInfo *s, Window w);
 #endif
 void set_docks_visible(ScreenInfo *s, int is_visible);
+void update_monitors(ScreenInfo *s);
+void update_workarea(ScreenInfo *s);
+void client_update_strut(Client *c);
+void relayout_screen(ScreenInfo *s, const Monitor *old, int num_old);
+Monitor *find_monitor(ScreenInfo *s, int x, int y);
+Monitor *find_monitor_rect(ScreenInfo *s, int x, int y, int w, int h);
+Monitor *client_monitor(Client *c);
+#ifdef VWM
+void client_update_monitor(Client *c);
+void set_current_monitor(ScreenInfo *s, int i);
+#endif
 ScreenInfo *find_screen(Window root);
 ScreenInfo *find_current_screen(void);
+void note_pointer_position(Window root, int x, int y);
+void forget_pointer_position(void);
+void forget_pointer_screen(void);
+void get_pointer_position(ScreenInfo *s, int *x, int *y);
 void grab_keys_for_screen(ScreenInfo *s);
+void grab_frame_buttons(Window frame);
+void grab_buttons_for_screen(ScreenInfo *s);
+void regrab_buttons(void);
 
 /* ewmh.c */
 
 void ewmh_init(void);
 void ewmh_init_screen(ScreenInfo *s);
 void ewmh_deinit_screen(ScreenInfo *s);
+void ewmh_set_screen_geometry(ScreenInfo *s);
+void ewmh_set_net_workarea(ScreenInfo *s);
 void ewmh_init_client(Client *c);
 void ewmh_deinit_client(Client *c);
 void ewmh_withdraw_client(Client *c);
 void ewmh_select_client(Client *c);
 void ewmh_set_net_client_list(ScreenInfo *s);
 void ewmh_set_net_client_list_stacking(ScreenInfo *s);
+void ewmh_add_net_client_list(Client *c);
+int ewmh_get_net_wm_bypass_compositor(Client *c);
+int ewmh_get_net_wm_strut(Client *c, int *strut);
+int ewmh_get_net_wm_ping(Client *c);
+void ewmh_send_net_wm_ping(Client *c, Time stamp);
+unsigned long ewmh_get_net_wm_pid(Client *c);
 #ifdef VWM
 void ewmh_set_net_current_desktop(ScreenInfo *s);
 #endif
@@ -321,5 +529,10 @@ void ewmh_set_net_active_window(Client *c);
 void ewmh_set_net_wm_desktop(Client *c);
 #endif
 unsigned int ewmh_get_net_wm_window_type(Window w);
+int ewmh_has_net_wm_state(Window w, Atom state);
 void ewmh_set_net_wm_state(Client *c);
 void ewmh_set_net_frame_extents(Window w);
+#ifdef SYNC
+XSyncCounter ewmh_get_net_wm_sync_request_counter(Client *c);
+void ewmh_send_net_wm_sync_request(Client *c, XSyncValue value);
+#endif
@@ -56,6 +56,10 @@ Atom xa_net_wm_state_maximized_vert;
 Atom xa_net_wm_state_maximized_horz;
 Atom xa_net_wm_state_fullscreen;
 Atom xa_net_wm_state_hidden;
+Atom xa_net_wm_fullscreen_monitors;
+Atom xa_net_wm_bypass_compositor;
+Atom xa_net_wm_strut;
+Atom xa_net_wm_strut_partial;
 static Atom xa_net_wm_allowed_actions;
 static Atom xa_net_wm_action_move;
 static Atom xa_net_wm_action_resize;
@@ -67,10 +71,18 @@ static Atom xa_net_wm_action_close;
 static Atom xa_net_wm_pid;
 Atom xa_net_frame_extents;
 
-/* Maintain a reasonably sized allocated block of memory for lists
- * of windows (for feeding to XChangeProperty in one hit). */
-static Window *window_array = NULL;
-static Window *alloc_window_array(void);
+/* Window Manager Protocols */
+Atom xa_net_wm_ping;
+#ifdef SYNC
+static Atom xa_net_wm_sync_request;
+static Atom xa_net_wm_sync_request_counter;
+#endif
+
+static int grow_window_list(Window **windows, int *size, int count);
+static void set_window_list(ScreenInfo *s, Atom prop, struct list *order,
+		Window **windows, int *count, int *size);
+static void append_window_list(ScreenInfo *s, Atom prop, Window w,
+		Window **windows, int *count, int *size);
 
 void ewmh_init(void) {
 	/* Standard X protocol atoms */
@@ -124,6 +136,10 @@ void ewmh_init(void) {
 	xa_net_wm_state_maximized_horz = XInternAtom(dpy, "_NET_WM_STATE_MAXIMIZED_HORZ", False);
 	xa_net_wm_state_fullscreen = XInternAtom(dpy, "_NET_WM_STATE_FULLSCREEN", False);
 	xa_net_wm_state_hidden = XInternAtom(dpy, "_NET_WM_STATE_HIDDEN", False);
+	xa_net_wm_fullscreen_monitors = XInternAtom(dpy, "_NET_WM_FULLSCREEN_MONITORS", False);
+	xa_net_wm_bypass_compositor = XInternAtom(dpy, "_NET_WM_BYPASS_COMPOSITOR", False);
+	xa_net_wm_strut = XInternAtom(dpy, "_NET_WM_STRUT", False);
+	xa_net_wm_strut_partial = XInternAtom(dpy, "_NET_WM_STRUT_PARTIAL", False);
 	xa_net_wm_allowed_actions = XInternAtom(dpy, "_NET_WM_ALLOWED_ACTIONS", False);
 	xa_net_wm_action_move = XInternAtom(dpy, "_NET_WM_ACTION_MOVE", False);
 	xa_net_wm_action_resize = XInternAtom(dpy, "_NET_WM_ACTION_RESIZE", False);
@@ -134,6 +150,13 @@ void ewmh_init(void) {
 	xa_net_wm_action_close = XInternAtom(dpy, "_NET_WM_ACTION_CLOSE", False);
 	xa_net_wm_pid = XInternAtom(dpy, "_NET_WM_PID", False);
 	xa_net_frame_extents = XInternAtom(dpy, "_NET_FRAME_EXTENTS", False);
+
+	/* Window Manager Protocols */
+	xa_net_wm_ping = XInternAtom(dpy, "_NET_WM_PING", False);
+#ifdef SYNC
+	xa_net_wm_sync_request = XInternAtom(dpy, "_NET_WM_SYNC_REQUEST", False);
+	xa_net_wm_sync_request_counter = XInternAtom(dpy, "_NET_WM_SYNC_REQUEST_COUNTER", False);
+#endif
 }
 
 void ewmh_init_screen(ScreenInfo *s) {
@@ -169,6 +192,10 @@ void ewmh_init_screen(ScreenInfo *s) {
 		xa_net_wm_state_maximized_horz,
 		xa_net_wm_state_fullscreen,
 		xa_net_wm_state_hidden,
+		xa_net_wm_fullscreen_monitors,
+		xa_net_wm_bypass_compositor,
+		xa_net_wm_strut,
+		xa_net_wm_strut_partial,
 		xa_net_wm_allowed_actions,
 		/* Not sure if it makes any sense including every action here
 		 * as they'll already be listed per-client in the
@@ -182,15 +209,17 @@ void ewmh_init_screen(ScreenInfo *s) {
 		xa_net_wm_action_change_desktop,
 		xa_net_wm_action_close,
 		xa_net_frame_extents,
+
+		xa_net_wm_ping,
+#ifdef SYNC
+		xa_net_wm_sync_request,
+		xa_net_wm_sync_request_counter,
+#endif
 	};
 #ifdef VWM
 	unsigned long num_desktops = 8;
 	unsigned long vdesk = s->vdesk;
 #endif
-	unsigned long workarea[4] = {
-		0, 0,
-		DisplayWidth(dpy, s->screen), DisplayHeight(dpy, s->screen)
-	};
 	s->supporting = XCreateSimpleWindow(dpy, s->root, 0, 0, 1, 1, 0, 0, 0);
 	XChangeProperty(dpy, s->root, xa_net_supported,
 			XA_ATOM, 32, PropModeReplace,
@@ -201,20 +230,12 @@ void ewmh_init_screen(ScreenInfo *s) {
 			XA_CARDINAL, 32, PropModeReplace,
 			(unsigned char *)&num_desktops, 1);
 #endif
-	XChangeProperty(dpy, s->root, xa_net_desktop_geometry,
-			XA_CARDINAL, 32, PropModeReplace,
-			(unsigned char *)&workarea[2], 2);
-	XChangeProperty(dpy, s->root, xa_net_desktop_viewport,
-			XA_CARDINAL, 32, PropModeReplace,
-			(unsigned char *)&workarea[0], 2);
+	ewmh_set_screen_geometry(s);
 #ifdef VWM
 	XChangeProperty(dpy, s->root, xa_net_current_desktop,
 			XA_CARDINAL, 32, PropModeReplace,
 			(unsigned char *)&vdesk, 1);
 #endif
-	XChangeProperty(dpy, s->root, xa_net_workarea,
-			XA_CARDINAL, 32, PropModeReplace,
-			(unsigned char *)&workarea, 4);
 	XChangeProperty(dpy, s->root, xa_net_supporting_wm_check,
 			XA_WINDOW, 32, PropModeReplace,
 			(unsigned char *)&s->supporting, 1);
@@ -229,10 +250,54 @@ void ewmh_init_screen(ScreenInfo *s) {
 			(unsigned char *)&pid, 1);
 }
 
+/* Desktop size, viewport and work area: set up front and again if the
+ * screen changes size */
+void ewmh_set_screen_geometry(ScreenInfo *s) {
+	unsigned long geometry[4] = {
+		0, 0,
+		DisplayWidth(dpy, s->screen), DisplayHeight(dpy, s->screen)
+	};
+	XChangeProperty(dpy, s->root, xa_net_desktop_geometry,
+			XA_CARDINAL, 32, PropModeReplace,
+			(unsigned char *)&geometry[2], 2);
+	XChangeProperty(dpy, s->root, xa_net_desktop_viewport,
+			XA_CARDINAL, 32, PropModeReplace,
+			(unsigned char *)&geometry[0], 2);
+	ewmh_set_net_workarea(s);
+}
+
+/* _NET_WORKAREA can only describe one rectangle, so it is the one
+ * bounding every monitor's work area */
+void ewmh_set_net_workarea(ScreenInfo *s) {
+	int x1 = s->monitors[0].wx, y1 = s->monitors[0].wy;
+	int x2 = x1 + s->monitors[0].wwidth, y2 = y1 + s->monitors[0].wheight;
+	unsigned long workarea[4];
+	int i;
+	for (i = 1; i < s->num_monitors; i++) {
+		Monitor *m = &s->monitors[i];
+		if (m->wx < x1) x1 = m->wx;
+		if (m->wy < y1) y1 = m->wy;
+		if (m->wx + m->wwidth > x2) x2 = m->wx + m->wwidth;
+		if (m->wy + m->wheight > y2) y2 = m->wy + m->wheight;
+	}
+	workarea[0] = x1;
+	workarea[1] = y1;
+	workarea[2] = x2 - x1;
+	workarea[3] = y2 - y1;
+	XChangeProperty(dpy, s->root, xa_net_workarea,
+			XA_CARDINAL, 32, PropModeReplace,
+			(unsigned char *)&workarea, 4);
+}
+
 void ewmh_deinit_screen(ScreenInfo *s) {
 	XDeleteProperty(dpy, s->root, xa_net_supported);
 	XDeleteProperty(dpy, s->root, xa_net_client_list);
 	XDeleteProperty(dpy, s->root, xa_net_client_list_stacking);
+	free(s->client_list);
+	free(s->client_list_stacking);
+	s->client_list = s->client_list_stacking = NULL;
+	s->client_list_count = s->client_list_stacking_count = 0;
+	s->client_list_size = s->client_list_stacking_size = 0;
 #ifdef VWM
 	XDeleteProperty(dpy, s->root, xa_net_number_of_desktops);
 #endif
@@ -284,34 +349,31 @@ void ewmh_select_client(Client *c) {
 	clients_tab_order = list_to_head(clients_tab_order, c);
 }
 
+/* Each screen keeps a copy of its client lists as last written to the
+ * root.  A new client (always last in both mapping and stacking order)
+ * is appended with PropModeAppend; anything else rewrites the list, and
+ * only if it actually changed. */
+
 void ewmh_set_net_client_list(ScreenInfo *s) {
-	Window *windows = alloc_window_array();
-	struct list *iter;
-	int i = 0;
-	for (iter = clients_mapping_order; iter; iter = iter->next) {
-		Client *c = iter->data;
-		if (c->screen == s) {
-			windows[i++] = c->window;
-		}
-	}
-	XChangeProperty(dpy, s->root, xa_net_client_list,
-			XA_WINDOW, 32, PropModeReplace,
-			(unsigned char *)windows, i);
+	set_window_list(s, xa_net_client_list, clients_mapping_order,
+			&s->client_list, &s->client_list_count,
+			&s->client_list_size);
 }
 
 void ewmh_set_net_client_list_stacking(ScreenInfo *s) {
-	Window *windows = alloc_window_array();
-	struct list *iter;
-	int i = 0;
-	for (iter = clients_stacking_order; iter; iter = iter->next) {
-		Client *c = iter->data;
-		if (c->screen == s) {
-			windows[i++] = c->window;
-		}
-	}
-	XChangeProperty(dpy, s->root, xa_net_client_list_stacking,
-			XA_WINDOW, 32, PropModeReplace,
-			(unsigned char *)windows, i);
+	set_window_list(s, xa_net_client_list_stacking, clients_stacking_order,
+			&s->client_list_stacking, &s->client_list_stacking_count,
+			&s->client_list_stacking_size);
+}
+
+void ewmh_add_net_client_list(Client *c) {
+	ScreenInfo *s = c->screen;
+	append_window_list(s, xa_net_client_list, c->window,
+			&s->client_list, &s->client_list_count,
+			&s->client_list_size);
+	append_window_list(s, xa_net_client_list_stacking, c->window,
+			&s->client_list_stacking, &s->client_list_stacking_count,
+			&s->client_list_stacking_size);
 }
 
 #ifdef VWM
@@ -365,15 +427,32 @@ unsigned int ewmh_get_net_wm_window_type(Window w) {
 	return type;
 }
 
+/* Check for a state the client set on itself before mapping */
+int ewmh_has_net_wm_state(Window w, Atom state) {
+	Atom *aprop;
+	unsigned long nitems, i;
+	int found = 0;
+	if ( (aprop = get_property(w, xa_net_wm_state, XA_ATOM, &nitems)) ) {
+		for (i = 0; i < nitems; i++) {
+			if (aprop[i] == state)
+				found = 1;
+		}
+		XFree(aprop);
+	}
+	return found;
+}
+
 void ewmh_set_net_wm_state(Client *c) {
-	Atom state[3];
+	Atom state[4];
 	int i = 0;
 	if (c->oldh)
 		state[i++] = xa_net_wm_state_maximized_vert;
 	if (c->oldw)
 		state[i++] = xa_net_wm_state_maximized_horz;
-	if (c->oldh && c->oldw)
+	if (c->fullscreen)
 		state[i++] = xa_net_wm_state_fullscreen;
+	if (c->hidden)
+		state[i++] = xa_net_wm_state_hidden;
 	XChangeProperty(dpy, c->window, xa_net_wm_state,
 			XA_ATOM, 32, PropModeReplace,
 			(unsigned char *)&state, i);
@@ -387,15 +466,188 @@ void ewmh_set_net_frame_extents(Window w) {
 			(unsigned char *)&extents, 4);
 }
 
-static Window *alloc_window_array(void) {
+/* Make room for count windows, growing in blocks of 128.  Returns 0 if
+ * out of memory. */
+static int grow_window_list(Window **windows, int *size, int count) {
+	Window *new;
+	int new_size;
+	if (count <= *size)
+		return 1;
+	new_size = (count + 127) & ~127;
+	new = realloc(*windows, new_size * sizeof(Window));
+	if (!new)
+		return 0;
+	*windows = new;
+	*size = new_size;
+	return 1;
+}
+
+static void set_window_list(ScreenInfo *s, Atom prop, struct list *order,
+		Window **windows, int *count, int *size) {
 	struct list *iter;
-	unsigned int count = 0;
-	for (iter = clients_mapping_order; iter; iter = iter->next) {
-		count++;
+	int i = 0, changed = 0;
+
+	for (iter = order; iter; iter = iter->next) {
+		Client *c = iter->data;
+		if (c->screen != s)
+			continue;
+		if (!grow_window_list(windows, size, i + 1)) {
+			LOG_ERROR("out of memory setting client list\n");
+			return;
+		}
+		if (i >= *count || (*windows)[i] != c->window) {
+			(*windows)[i] = c->window;
+			changed = 1;
+		}
+		i++;
+	}
+	if (!changed && i == *count)
+		return;
+	*count = i;
+	XChangeProperty(dpy, s->root, prop,
+			XA_WINDOW, 32, PropModeReplace,
+			(unsigned char *)*windows, i);
+}
+
+static void append_window_list(ScreenInfo *s, Atom prop, Window w,
+		Window **windows, int *count, int *size) {
+	/* Already there if the list was rewritten since the client was
+	 * added to the order (e.g., it was raised while being set up) */
+	if (*count > 0 && (*windows)[*count - 1] == w)
+		return;
+	if (!grow_window_list(windows, size, *count + 1)) {
+		LOG_ERROR("out of memory setting client list\n");
+		return;
 	}
-	if (count == 0) count++;
-	/* Round up to next block of 128 */
-	count = (count + 127) & ~127;
-	window_array = realloc(window_array, count * sizeof(Window));
-	return window_array;
+	(*windows)[(*count)++] = w;
+	/* The first write replaces anything left by a previous manager */
+	XChangeProperty(dpy, s->root, prop,
+			XA_WINDOW, 32, *count == 1 ? PropModeReplace : PropModeAppend,
+			(unsigned char *)&w, 1);
 }
+
+/* 0 for no preference, 1 to ask not to be composited, 2 to ask to be */
+int ewmh_get_net_wm_bypass_compositor(Client *c) {
+	unsigned long nitems, *prop;
+	int bypass = 0;
+	if ( (prop = get_property(c->window, xa_net_wm_bypass_compositor, XA_CARDINAL, &nitems)) ) {
+		if (nitems > 0 && prop[0] <= 2)
+			bypass = prop[0];
+		XFree(prop);
+	}
+	return bypass;
+}
+
+/* Space the client reserves at the screen edges, as the twelve values of
+ * _NET_WM_STRUT_PARTIAL (which a plain _NET_WM_STRUT is converted to).
+ * Returns true if it reserves any. */
+int ewmh_get_net_wm_strut(Client *c, int *strut) {
+	unsigned long nitems, *prop;
+	int i, partial = 0;
+
+	for (i = 0; i < 12; i++)
+		strut[i] = 0;
+	if ( (prop = get_property(c->window, xa_net_wm_strut_partial, XA_CARDINAL, &nitems)) ) {
+		if (nitems >= 12) {
+			for (i = 0; i < 12; i++)
+				strut[i] = prop[i];
+			partial = 1;
+		}
+		XFree(prop);
+	}
+	if (!partial && (prop = get_property(c->window, xa_net_wm_strut, XA_CARDINAL, &nitems)) ) {
+		if (nitems >= 4) {
+			for (i = 0; i < 4; i++)
+				strut[i] = prop[i];
+			/* Whole edges */
+			strut[5] = strut[7] = DisplayHeight(dpy, c->screen->screen) - 1;
+			strut[9] = strut[11] = DisplayWidth(dpy, c->screen->screen) - 1;
+		}
+		XFree(prop);
+	}
+	return strut[0] || strut[1] || strut[2] || strut[3];
+}
+
+/* True if the client will answer _NET_WM_PING */
+int ewmh_get_net_wm_ping(Client *c) {
+	Atom *protocols;
+	int i, n, found = 0;
+
+	if (XGetWMProtocols(dpy, c->window, &protocols, &n)) {
+		for (i = 0; i < n; i++)
+			if (protocols[i] == xa_net_wm_ping)
+				found = 1;
+		XFree(protocols);
+	}
+	return found;
+}
+
+void ewmh_send_net_wm_ping(Client *c, Time stamp) {
+	XEvent ev;
+
+	ev.type = ClientMessage;
+	ev.xclient.window = c->window;
+	ev.xclient.message_type = xa_wm_protos;
+	ev.xclient.format = 32;
+	ev.xclient.data.l[0] = xa_net_wm_ping;
+	ev.xclient.data.l[1] = stamp;
+	ev.xclient.data.l[2] = c->window;
+	ev.xclient.data.l[3] = 0;
+	ev.xclient.data.l[4] = 0;
+	XSendEvent(dpy, c->window, False, NoEventMask, &ev);
+}
+
+/* Process ID of the client, or 0 if it doesn't say */
+unsigned long ewmh_get_net_wm_pid(Client *c) {
+	unsigned long nitems, *prop;
+	unsigned long pid = 0;
+	if ( (prop = get_property(c->window, xa_net_wm_pid, XA_CARDINAL, &nitems)) ) {
+		if (nitems > 0)
+			pid = prop[0];
+		XFree(prop);
+	}
+	return pid;
+}
+
+#ifdef SYNC
+/* Counter to wait on after sending _NET_WM_SYNC_REQUEST, or None if the
+ * client doesn't take part in the protocol */
+XSyncCounter ewmh_get_net_wm_sync_request_counter(Client *c) {
+	Atom *protocols;
+	int i, n, found = 0;
+	unsigned long nitems, *prop;
+	XSyncCounter counter = None;
+
+	if (!have_sync)
+		return None;
+	if (XGetWMProtocols(dpy, c->window, &protocols, &n)) {
+		for (i = 0; i < n; i++)
+			if (protocols[i] == xa_net_wm_sync_request)
+				found = 1;
+		XFree(protocols);
+	}
+	if (!found)
+		return None;
+	if ( (prop = get_property(c->window, xa_net_wm_sync_request_counter, XA_CARDINAL, &nitems)) ) {
+		if (nitems >= 1)
+			counter = prop[0];
+		XFree(prop);
+	}
+	return counter;
+}
+
+void ewmh_send_net_wm_sync_request(Client *c, XSyncValue value) {
+	XEvent ev;
+
+	ev.type = ClientMessage;
+	ev.xclient.window = c->window;
+	ev.xclient.message_type = xa_wm_protos;
+	ev.xclient.format = 32;
+	ev.xclient.data.l[0] = xa_net_wm_sync_request;
+	ev.xclient.data.l[1] = CurrentTime;
+	ev.xclient.data.l[2] = XSyncValueLow32(value);
+	ev.xclient.data.l[3] = XSyncValueHigh32(value);
+	ev.xclient.data.l[4] = 0;
+	XSendEvent(dpy, c->window, False, NoEventMask, &ev);
+}
+#endif
@@ -25,8 +25,20 @@ ScreenInfo  *screens;
 #ifdef SHAPE
 int         have_shape, shape_event;
 #endif
+#ifdef SYNC
+int         have_sync, sync_event_base;
+#endif
+#ifdef XINPUT2
+int         have_xi2, have_xi2_raw, xi2_opcode;
+#endif
 #ifdef RANDR
-int         have_randr, randr_event_base;
+int         have_randr, randr_event_base, have_randr_monitors;
+#endif
+#ifdef XINERAMA
+int         have_xinerama;
+#endif
+#ifdef COMPOSITE
+int         have_composite, damage_event_base;
 #endif
 
 /* Things that affect user interaction */
@@ -35,6 +47,7 @@ static const char   *opt_display = "";
 static const char   *opt_font = DEF_FONT;
 static const char   *opt_fg = DEF_FG;
 static const char   *opt_bg = DEF_BG;
+static const char   *opt_hc = DEF_HC;
 #ifdef VWM
 static const char   *opt_fc = DEF_FC;
 #endif
@@ -49,6 +62,24 @@ static const char *const def_term[] = { DEF_TERM, NULL };
 char **opt_term = (char **)def_term;
 int          opt_bw = DEF_BW;
 int          opt_snap = 0;
+int          opt_framepool = DEF_FRAMEPOOL;
+int          opt_frameless = 0;
+int          opt_dragrate = 0;  /* 0 means display refresh rate */
+int          opt_solidsweep = 0;
+int          opt_rootgrabs = 0;
+int          opt_keyaccel = 0;
+int          opt_cyclehighlight = 0;
+int          opt_park = 0;
+int          opt_ping = 0;  /* seconds between pings, 0 to only ping on close */
+int          opt_killdelay = 0;  /* 0 means never kill automatically */
+int          opt_focusdelay = 0;  /* ms, 0 to focus on entry */
+#ifdef VWM
+int          opt_containers = 0;
+int          opt_monitordesks = 0;
+#endif
+#ifdef COMPOSITE
+int          opt_composite = 0;
+#endif
 #ifdef SOLIDDRAG
 int          no_solid_drag = 0;  /* use solid drag by default */
 #endif
@@ -63,6 +94,9 @@ volatile Window initialising = None;
 
 /* Event loop will run until this flag is set */
 int wm_exit;
+int wm_restart;
+/* Set by SIGHUP to re-read configuration */
+int wm_reload;
 
 static void set_app(const char *arg);
 static void set_app_geometry(const char *arg);
@@ -77,12 +111,24 @@ static struct xconfig_option evilwm_options[] = {
 	{ XCONFIG_STRING,   "display",      &opt_display },
 	{ XCONFIG_STRING,   "fg",           &opt_fg },
 	{ XCONFIG_STRING,   "bg",           &opt_bg },
+	{ XCONFIG_STRING,   "hc",           &opt_hc },
 #ifdef VWM
 	{ XCONFIG_STRING,   "fc",           &opt_fc },
 #endif
 	{ XCONFIG_INT,      "bw",           &opt_bw },
 	{ XCONFIG_STR_LIST, "term",         &opt_term },
 	{ XCONFIG_INT,      "snap",         &opt_snap },
+	{ XCONFIG_INT,      "framepool",    &opt_framepool },
+	{ XCONFIG_INT,      "frameless",    &opt_frameless },
+	{ XCONFIG_INT,      "dragrate",     &opt_dragrate },
+	{ XCONFIG_BOOL,     "solidsweep",   &opt_solidsweep },
+	{ XCONFIG_BOOL,     "rootgrabs",    &opt_rootgrabs },
+	{ XCONFIG_BOOL,     "keyaccel",     &opt_keyaccel },
+	{ XCONFIG_BOOL,     "cyclehighlight", &opt_cyclehighlight },
+	{ XCONFIG_BOOL,     "park",         &opt_park },
+	{ XCONFIG_INT,      "ping",         &opt_ping },
+	{ XCONFIG_INT,      "killdelay",    &opt_killdelay },
+	{ XCONFIG_INT,      "focusdelay",   &opt_focusdelay },
 	{ XCONFIG_STRING,   "mask1",        &opt_grabmask1 },
 	{ XCONFIG_STRING,   "mask2",        &opt_grabmask2 },
 	{ XCONFIG_STRING,   "altmask",      &opt_altmask },
@@ -91,6 +137,8 @@ static struct xconfig_option evilwm_options[] = {
 	{ XCONFIG_CALL_1,   "g",            &set_app_geometry },
 	{ XCONFIG_CALL_0,   "dock",         &set_app_dock },
 #ifdef VWM
+	{ XCONFIG_BOOL,     "containers",   &opt_containers },
+	{ XCONFIG_BOOL,     "monitordesks", &opt_monitordesks },
 	{ XCONFIG_CALL_1,   "vdesk",        &set_app_vdesk },
 	{ XCONFIG_CALL_1,   "v",            &set_app_vdesk },
 	{ XCONFIG_CALL_0,   "fixed",        &set_app_fixed },
@@ -99,11 +147,15 @@ static struct xconfig_option evilwm_options[] = {
 #endif
 #ifdef SOLIDDRAG
 	{ XCONFIG_BOOL,     "nosoliddrag",  &no_solid_drag },
+#endif
+#ifdef COMPOSITE
+	{ XCONFIG_BOOL,     "composite",    &opt_composite },
 #endif
 	{ XCONFIG_END, NULL, NULL }
 };
 
 static void setup_display(void);
+static void close_display(int restarting);
 static void *xmalloc(size_t size);
 static unsigned int parse_modifiers(char *s);
 
@@ -115,15 +167,20 @@ static void helptext(void) {
 #ifdef VWM
 " [-fc fixed]"
 #endif
-" [-bg background] [-bw borderwidth]\n"
+" [-bg background] [-hc hung] [-bw borderwidth]\n"
 "              [-mask1 modifiers] [-mask2 modifiers] [-altmask modifiers]\n"
-"              [-snap num]"
+"              [-snap num] [-framepool num] [-frameless mode]"
 " [-app name/class] [-g geometry] [-dock]\n"
 #ifdef VWM
-"              [-v vdesk] [-s]"
+"              [-v vdesk] [-s] [-containers] [-monitordesks]"
 #endif
 #ifdef SOLIDDRAG
-" [-nosoliddrag]"
+" [-nosoliddrag] [-dragrate hz]"
+#endif
+" [-solidsweep] [-rootgrabs] [-keyaccel] [-cyclehighlight] [-park]\n"
+"              [-ping secs] [-killdelay secs] [-focusdelay ms]"
+#ifdef COMPOSITE
+" [-composite]"
 #endif
 " [-V]"
 	);
@@ -132,20 +189,39 @@ static void helptext(void) {
 #define helptext()
 #endif
 
+/* Kept for re-reading options on SIGHUP */
+static int saved_argc;
+static char **saved_argv;
+
+static enum xconfig_result parse_config_file(void) {
+	enum xconfig_result ret = XCONFIG_FILE_ERROR;
+	const char *home = getenv("HOME");
+	if (home) {
+		char *conffile = xmalloc(strlen(home) + sizeof(CONFIG_FILE) + 2);
+		strcpy(conffile, home);
+		strcat(conffile, "/" CONFIG_FILE);
+		ret = xconfig_parse_file(evilwm_options, conffile);
+		free(conffile);
+	}
+	return ret;
+}
+
+static void set_modifiers(void) {
+	grabmask1 = ControlMask|Mod1Mask;
+	grabmask2 = Mod1Mask;
+	altmask = ShiftMask;
+	if (opt_grabmask1) grabmask1 = parse_modifiers(opt_grabmask1);
+	if (opt_grabmask2) grabmask2 = parse_modifiers(opt_grabmask2);
+	if (opt_altmask) altmask = parse_modifiers(opt_altmask);
+}
+
 int main(int argc, char *argv[]) {
 	struct sigaction act;
 	int argn = 1, ret;
 
-	{
-		const char *home = getenv("HOME");
-		if (home) {
-			char *conffile = xmalloc(strlen(home) + sizeof(CONFIG_FILE) + 2);
-			strcpy(conffile, home);
-			strcat(conffile, "/" CONFIG_FILE);
-			xconfig_parse_file(evilwm_options, conffile);
-			free(conffile);
-		}
-	}
+	saved_argc = argc;
+	saved_argv = argv;
+	parse_config_file();
 	ret = xconfig_parse_cli(evilwm_options, argc, argv, &argn);
 	if (ret == XCONFIG_MISSING_ARG) {
 		fprintf(stderr, "%s: missing argument to `%s'\n", argv[0], argv[argn]);
@@ -167,39 +243,338 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	if (opt_grabmask1) grabmask1 = parse_modifiers(opt_grabmask1);
-	if (opt_grabmask2) grabmask2 = parse_modifiers(opt_grabmask2);
-	if (opt_altmask) altmask = parse_modifiers(opt_altmask);
+	set_modifiers();
 
-	wm_exit = 0;
 	act.sa_handler = handle_signal;
 	sigemptyset(&act.sa_mask);
 	act.sa_flags = 0;
 	sigaction(SIGTERM, &act, NULL);
 	sigaction(SIGINT, &act, NULL);
 	sigaction(SIGHUP, &act, NULL);
+	sigaction(SIGUSR1, &act, NULL);
+
+	for (;;) {
+		wm_exit = wm_restart = 0;
+		setup_display();
+		event_main_loop();
+		if (!wm_restart)
+			break;
+		/* Restart in place.  If the exec fails, carry on in this
+		 * process, picking up the state just saved. */
+		if (restart_save() < 0) {
+			wm_exit = wm_restart = 0;
+			event_main_loop();
+			break;
+		}
+		close_display(1);
+		restart_exec(argv);
+	}
 
-	setup_display();
+	/* Quit Nicely */
+	close_display(0);
 
-	event_main_loop();
+	return 0;
+}
 
-	/* Quit Nicely */
-	while (clients_stacking_order)
-		remove_client(clients_stacking_order->data);
-	XSetInputFocus(dpy, PointerRoot, RevertToPointerRoot, CurrentTime);
+static void close_display(int restarting) {
+	int i;
+
+#ifdef VWM
+	for (i = 0; i < num_screens; i++)
+		vdesk_containers_deinit(&screens[i]);
+#endif
+	if (restarting) {
+		/* Leave frames where they are for the next process to adopt.
+		 * Selections made at frame creation would stop it selecting
+		 * the same events, so clear those first. */
+		XSetCloseDownMode(dpy, RetainTemporary);
+		while (clients_stacking_order) {
+			Client *c = clients_stacking_order->data;
+			XSelectInput(dpy, c->parent, NoEventMask);
+			clients_stacking_order = list_delete(clients_stacking_order, c);
+			clients_tab_order = list_delete(clients_tab_order, c);
+			clients_mapping_order = list_delete(clients_mapping_order, c);
+			c->screen->struts = list_delete(c->screen->struts, c);
+			free(c->cmap_windows);
+			free(c->cmaps);
+			free(c);
+		}
+		current = NULL;
+	} else {
+		while (clients_stacking_order)
+			remove_client(clients_stacking_order->data);
+		XSetInputFocus(dpy, PointerRoot, RevertToPointerRoot, CurrentTime);
+	}
 	if (font) XFreeFont(dpy, font);
-	{
-		int i;
-		for (i = 0; i < num_screens; i++) {
-			ewmh_deinit_screen(&screens[i]);
-			XFreeGC(dpy, screens[i].invert_gc);
+	XFreeCursor(dpy, move_curs);
+	XFreeCursor(dpy, resize_curs);
+	for (i = 0; i < num_screens; i++) {
+#ifdef COMPOSITE
+		composite_deinit_screen(&screens[i]);
+#endif
+		frame_pool_deinit(&screens[i]);
+		ewmh_deinit_screen(&screens[i]);
+		XFreeGC(dpy, screens[i].invert_gc);
+		if (!restarting)
 			XInstallColormap(dpy, DefaultColormap(dpy, i));
-		}
 	}
 	free(screens);
 	XCloseDisplay(dpy);
+}
 
-	return 0;
+/**************************************************************************/
+/* Configuration reload (SIGHUP) */
+
+/* String options are either their default literal or strdup()ed */
+static void free_option(const char *value, const char *def) {
+	if (value && value != def)
+		free((char *)value);
+}
+
+static void free_applications(struct list *apps) {
+	while (apps) {
+		Application *a = apps->data;
+		apps = list_delete(apps, a);
+		free(a->res_name);
+		free(a->res_class);
+		free(a);
+	}
+}
+
+#define NUM_OPTIONS (sizeof(evilwm_options) / sizeof(evilwm_options[0]))
+
+static void save_string_options(void **values) {
+	unsigned i;
+	for (i = 0; i < NUM_OPTIONS; i++) {
+		if (evilwm_options[i].type == XCONFIG_STRING
+				|| evilwm_options[i].type == XCONFIG_STR_LIST)
+			values[i] = *(void **)evilwm_options[i].dest;
+	}
+}
+
+/* The parser strdup()s every string it's given without freeing what it
+ * replaces, so a string option set in the config file and again on the
+ * command line would leak its file value on every reload.  Values still
+ * as they were reset are defaults, and weren't allocated. */
+static void free_replaced_options(void **defaults, void **from_file) {
+	unsigned i;
+	for (i = 0; i < NUM_OPTIONS; i++) {
+		enum xconfig_option_type type = evilwm_options[i].type;
+		if (type != XCONFIG_STRING && type != XCONFIG_STR_LIST)
+			continue;
+		if (from_file[i] == defaults[i]
+				|| from_file[i] == *(void **)evilwm_options[i].dest)
+			continue;
+		if (type == XCONFIG_STR_LIST && from_file[i])
+			free(((char **)from_file[i])[0]);
+		free(from_file[i]);
+	}
+}
+
+static int option_changed(const char *old, const char *new) {
+	return strcmp(old, new) != 0;
+}
+
+/* Modes that existing clients (or whole screens) are set up for can't be
+ * switched on the fly: keep the running value until the next restart */
+static void keep_startup_option(int *value, int old, const char *name) {
+	(void)name;  /* unused without STDIO */
+	if (*value != old) {
+		LOG_ERROR("-%s only changes when evilwm restarts\n", name);
+		*value = old;
+	}
+}
+
+/* Allocate a new colour by name, only freeing the old one if that worked */
+static void realloc_colour(ScreenInfo *s, const char *name, XColor *colour) {
+	XColor new, dummy;
+	if (XAllocNamedColor(dpy, DefaultColormap(dpy, s->screen), name, &new, &dummy)) {
+		XFreeColors(dpy, DefaultColormap(dpy, s->screen), &colour->pixel, 1, 0);
+		*colour = new;
+	}
+}
+
+/* Re-read the config file (and reapply the command line on top of it),
+ * then apply only what actually changed to the running session. */
+void reload_config(void) {
+	const char *old_display = opt_display;
+	const char *old_font = opt_font;
+	const char *old_fg = opt_fg;
+	const char *old_bg = opt_bg;
+	const char *old_hc = opt_hc;
+#ifdef VWM
+	const char *old_fc = opt_fc;
+#endif
+	char *old_grabmask1 = opt_grabmask1;
+	char *old_grabmask2 = opt_grabmask2;
+	char *old_altmask = opt_altmask;
+	char **old_term = opt_term;
+	struct list *old_applications = applications;
+	unsigned int old_mask1 = grabmask1, old_mask2 = grabmask2, old_alt = altmask;
+	int old_bw = opt_bw;
+	int old_framepool = opt_framepool;
+	int old_rootgrabs = opt_rootgrabs;
+	int old_frameless = opt_frameless;
+	int old_park = opt_park;
+#ifdef VWM
+	int old_containers = opt_containers;
+	int old_monitordesks = opt_monitordesks;
+#endif
+#ifdef COMPOSITE
+	int old_composite = opt_composite;
+#endif
+	void *defaults[NUM_OPTIONS], *from_file[NUM_OPTIONS];
+	int colours_changed = 0;
+	int i;
+
+	LOG_ENTER("reload_config()");
+
+	/* Back to defaults, so that options removed from the file revert */
+	opt_font = DEF_FONT;
+	opt_fg = DEF_FG;
+	opt_bg = DEF_BG;
+	opt_hc = DEF_HC;
+#ifdef VWM
+	opt_fc = DEF_FC;
+#endif
+	opt_grabmask1 = opt_grabmask2 = opt_altmask = NULL;
+	opt_term = (char **)def_term;
+	opt_bw = DEF_BW;
+	opt_snap = 0;
+	opt_framepool = DEF_FRAMEPOOL;
+	opt_frameless = 0;
+	opt_dragrate = 0;
+	opt_solidsweep = 0;
+	opt_rootgrabs = 0;
+	opt_keyaccel = 0;
+	opt_cyclehighlight = 0;
+	opt_park = 0;
+	opt_ping = 0;
+	opt_killdelay = 0;
+	opt_focusdelay = 0;
+#ifdef VWM
+	opt_containers = 0;
+	opt_monitordesks = 0;
+#endif
+#ifdef SOLIDDRAG
+	no_solid_drag = 0;
+#endif
+#ifdef COMPOSITE
+	opt_composite = 0;
+#endif
+	applications = NULL;
+
+	save_string_options(defaults);
+	if (parse_config_file() == XCONFIG_BAD_OPTION) {
+		LOG_ERROR("bad option in " CONFIG_FILE ", ignoring rest of file\n");
+	}
+	save_string_options(from_file);
+	xconfig_parse_cli(evilwm_options, saved_argc, saved_argv, NULL);
+	free_replaced_options(defaults, from_file);
+	set_modifiers();
+
+	/* Can't change display without starting again */
+	if (opt_display != old_display) {
+		free_option(opt_display, "");
+		opt_display = old_display;
+	}
+	keep_startup_option(&opt_frameless, old_frameless, "frameless");
+	keep_startup_option(&opt_park, old_park, "park");
+#ifdef VWM
+	keep_startup_option(&opt_containers, old_containers, "containers");
+	keep_startup_option(&opt_monitordesks, old_monitordesks, "monitordesks");
+#endif
+#ifdef COMPOSITE
+	keep_startup_option(&opt_composite, old_composite, "composite");
+#endif
+
+	if (option_changed(old_font, opt_font)) {
+		XFontStruct *new_font = XLoadQueryFont(dpy, opt_font);
+		LOG_DEBUG("font changed\n");
+		if (new_font) {
+			XFreeFont(dpy, font);
+			font = new_font;
+			for (i = 0; i < num_screens; i++)
+				XSetFont(dpy, screens[i].invert_gc, font->fid);
+		}
+	}
+
+	for (i = 0; i < num_screens; i++) {
+		ScreenInfo *s = &screens[i];
+		if (option_changed(old_fg, opt_fg)) {
+			realloc_colour(s, opt_fg, &s->fg);
+			colours_changed = 1;
+		}
+		if (option_changed(old_bg, opt_bg)) {
+			realloc_colour(s, opt_bg, &s->bg);
+			colours_changed = 1;
+		}
+		if (option_changed(old_hc, opt_hc)) {
+			realloc_colour(s, opt_hc, &s->hc);
+			colours_changed = 1;
+		}
+#ifdef VWM
+		if (option_changed(old_fc, opt_fc)) {
+			realloc_colour(s, opt_fc, &s->fc);
+			colours_changed = 1;
+		}
+#endif
+	}
+
+	if (grabmask1 != old_mask1 || grabmask2 != old_mask2 || altmask != old_alt) {
+		LOG_DEBUG("modifiers changed\n");
+		for (i = 0; i < num_screens; i++)
+			grab_keys_for_screen(&screens[i]);
+	}
+
+	if (grabmask2 != old_mask2 || altmask != old_alt
+			|| opt_rootgrabs != old_rootgrabs) {
+		regrab_buttons();
+	} else if (opt_framepool != old_framepool) {
+		for (i = 0; i < num_screens; i++) {
+			frame_pool_deinit(&screens[i]);
+			frame_pool_init(&screens[i]);
+		}
+	}
+
+	if (colours_changed || opt_bw != old_bw) {
+		struct list *iter;
+		for (iter = clients_tab_order; iter; iter = iter->next) {
+			Client *c = iter->data;
+			if (colours_changed)
+				client_set_border_colour(c, c == current);
+			/* Clients that asked for no border keep none */
+			if (opt_bw != old_bw && c->border == old_bw
+					&& !is_frameless(c)) {
+				XWindowChanges wc;
+				gravitate_border(c, -c->border);
+				c->border = opt_bw;
+				gravitate_border(c, c->border);
+				wc.x = frame_x(c);
+				wc.y = frame_y(c);
+				wc.border_width = c->border;
+				XConfigureWindow(dpy, c->parent, CWX|CWY|CWBorderWidth, &wc);
+				send_config(c);
+			}
+		}
+	}
+
+	free_option(old_font, DEF_FONT);
+	free_option(old_fg, DEF_FG);
+	free_option(old_bg, DEF_BG);
+	free_option(old_hc, DEF_HC);
+#ifdef VWM
+	free_option(old_fc, DEF_FC);
+#endif
+	free(old_grabmask1);
+	free(old_grabmask2);
+	free(old_altmask);
+	if (old_term != (char **)def_term) {
+		free(old_term[0]);
+		free(old_term);
+	}
+	free_applications(old_applications);
+	LOG_LEAVE();
 }
 
 static void *xmalloc(size_t size) {
@@ -218,11 +593,33 @@ static void *xmalloc(size_t size) {
 	return ptr;
 }
 
+/* Find out which modifier is NumLock - we'll use this when grabbing
+ * every combination of modifiers we can think of.  Returns true if it
+ * changed. */
+int update_numlockmask(void) {
+	unsigned int old = numlockmask;
+	XModifierKeymap *modmap;
+	KeyCode numlock = XKeysymToKeycode(dpy, XK_Num_Lock);
+	int i, j;
+
+	numlockmask = 0;
+	modmap = XGetModifierMapping(dpy);
+	for (i = 0; i < 8; i++) {
+		for (j = 0; j < modmap->max_keypermod; j++) {
+			if (numlock && modmap->modifiermap[i*modmap->max_keypermod+j] == numlock) {
+				numlockmask = (1<<i);
+				LOG_DEBUG("XK_Num_Lock is (1<<0x%02x)\n", i);
+			}
+		}
+	}
+	XFreeModifiermap(modmap);
+	return numlockmask != old;
+}
+
 static void setup_display(void) {
 	XGCValues gv;
 	XSetWindowAttributes attr;
 	XColor dummy;
-	XModifierKeymap *modmap;
 	/* used in scanning windows (XQueryTree) */
 	unsigned int i, j, nwins;
 	Window dw1, dw2, *wins;
@@ -241,6 +638,9 @@ static void setup_display(void) {
 	/* Standard & EWMH atoms */
 	ewmh_init();
 
+	/* State handed over by a previous process restarting in place */
+	restart_load();
+
 	font = XLoadQueryFont(dpy, opt_font);
 	if (!font) font = XLoadQueryFont(dpy, DEF_FONT);
 	if (!font) {
@@ -251,18 +651,7 @@ static void setup_display(void) {
 	move_curs = XCreateFontCursor(dpy, XC_fleur);
 	resize_curs = XCreateFontCursor(dpy, XC_plus);
 
-	/* find out which modifier is NumLock - we'll use this when grabbing
-	 * every combination of modifiers we can think of */
-	modmap = XGetModifierMapping(dpy);
-	for (i = 0; i < 8; i++) {
-		for (j = 0; j < (unsigned int)modmap->max_keypermod; j++) {
-			if (modmap->modifiermap[i*modmap->max_keypermod+j] == XKeysymToKeycode(dpy, XK_Num_Lock)) {
-				numlockmask = (1<<i);
-				LOG_DEBUG("XK_Num_Lock is (1<<0x%02x)\n", i);
-			}
-		}
-	}
-	XFreeModifiermap(modmap);
+	update_numlockmask();
 
 	/* set up GC parameters - same for each screen */
 	gv.function = GXinvert;
@@ -271,7 +660,7 @@ static void setup_display(void) {
 	gv.font = font->fid;
 
 	/* set up root window attributes - same for each screen */
-	attr.event_mask = ChildMask | EnterWindowMask | ColormapChangeMask;
+	attr.event_mask = ChildMask | EnterWindowMask | LeaveWindowMask | ColormapChangeMask;
 
 	/* SHAPE extension? */
 #ifdef SHAPE
@@ -279,14 +668,69 @@ static void setup_display(void) {
 		int e_dummy;
 		have_shape = XShapeQueryExtension(dpy, &shape_event, &e_dummy);
 	}
+#endif
+	/* SYNC extension? */
+#ifdef SYNC
+	{
+		int e_dummy, major, minor;
+		have_sync = XSyncQueryExtension(dpy, &sync_event_base, &e_dummy)
+			&& XSyncInitialize(dpy, &major, &minor);
+	}
+#endif
+	/* XInput2 extension?  Raw events only reach us during our own grab
+	 * from version 2.1. */
+#ifdef XINPUT2
+	{
+		int e_dummy, major = 2, minor = 1;
+		have_xi2 = XQueryExtension(dpy, "XInputExtension", &xi2_opcode, &e_dummy, &e_dummy)
+			&& XIQueryVersion(dpy, &major, &minor) == Success;
+		have_xi2_raw = have_xi2 && (major > 2 || minor >= 1);
+		if (!have_xi2) {
+			LOG_DEBUG("XInput2 is not supported on this display.\n");
+		}
+	}
 #endif
 	/* Xrandr extension? */
 #ifdef RANDR
 	{
 		int e_dummy;
+		int major = 1, minor = 5;
 		have_randr = XRRQueryExtension(dpy, &randr_event_base, &e_dummy);
 		if (!have_randr) {
 			LOG_DEBUG("XRandR is not supported on this display.\n");
+		} else {
+			/* Monitors (as opposed to just CRTCs) arrived in 1.5 */
+			have_randr_monitors = XRRQueryVersion(dpy, &major, &minor)
+				&& (major > 1 || minor >= 5);
+		}
+	}
+#endif
+	/* Xinerama extension, for monitor layout without RandR 1.5? */
+#ifdef XINERAMA
+	{
+		int e_dummy;
+		have_xinerama = XineramaQueryExtension(dpy, &e_dummy, &e_dummy)
+			&& XineramaIsActive(dpy);
+	}
+#endif
+
+	/* Composite, with Damage, XFixes and Render for painting? */
+#ifdef COMPOSITE
+	if (opt_composite) {
+		int e_dummy, major = 0, minor = 3;
+		int fixes_major = 2, fixes_minor = 0;
+		int damage_major = 1, damage_minor = 1;
+		have_composite = XCompositeQueryExtension(dpy, &e_dummy, &e_dummy)
+			&& XCompositeQueryVersion(dpy, &major, &minor)
+			&& (major > 0 || minor >= 3)
+			&& XDamageQueryExtension(dpy, &damage_event_base, &e_dummy)
+			&& XDamageQueryVersion(dpy, &damage_major, &damage_minor)
+			&& XFixesQueryExtension(dpy, &e_dummy, &e_dummy)
+			&& XFixesQueryVersion(dpy, &fixes_major, &fixes_minor)
+			&& fixes_major >= 2
+			&& XRenderQueryExtension(dpy, &e_dummy, &e_dummy);
+		if (!have_composite) {
+			LOG_ERROR("Composite, Damage, XFixes or Render missing: not compositing\n");
 		}
 	}
 #endif
@@ -323,10 +767,21 @@ static void setup_display(void) {
 #endif
 #ifdef VWM
 		screens[i].vdesk = KEY_TO_VDESK(XK_1);
+		screens[i].old_vdesk = screens[i].vdesk;
+		screens[i].current_monitor = 0;
 #endif
+		screens[i].num_monitors = 0;
+		screens[i].struts = NULL;
+		screens[i].installed_cmap = None;
+		screens[i].installed_cmap_for = None;
+		update_monitors(&screens[i]);
+		screens[i].client_list = screens[i].client_list_stacking = NULL;
+		screens[i].client_list_count = screens[i].client_list_stacking_count = 0;
+		screens[i].client_list_size = screens[i].client_list_stacking_size = 0;
 
 		XAllocNamedColor(dpy, DefaultColormap(dpy, i), opt_fg, &screens[i].fg, &dummy);
 		XAllocNamedColor(dpy, DefaultColormap(dpy, i), opt_bg, &screens[i].bg, &dummy);
+		XAllocNamedColor(dpy, DefaultColormap(dpy, i), opt_hc, &screens[i].hc, &dummy);
 #ifdef VWM
 		XAllocNamedColor(dpy, DefaultColormap(dpy, i), opt_fc, &screens[i].fc, &dummy);
 #endif
@@ -335,22 +790,36 @@ static void setup_display(void) {
 
 		XChangeWindowAttributes(dpy, screens[i].root, CWEventMask, &attr);
 		grab_keys_for_screen(&screens[i]);
+		grab_buttons_for_screen(&screens[i]);
 		screens[i].docks_visible = 1;
 
+		/* adopt frames left by a previous process */
+		restart_restore_screen(&screens[i]);
+#ifdef VWM
+		vdesk_containers_init(&screens[i]);
+#endif
+
 		/* scan all the windows on this screen */
 		LOG_XENTER("XQueryTree(screen=%d)", i);
 		XQueryTree(dpy, screens[i].root, &dw1, &dw2, &wins, &nwins);
 		LOG_XDEBUG("%d windows\n", nwins);
 		LOG_XLEAVE();
 		for (j = 0; j < nwins; j++) {
+			if (find_client(wins[j]))
+				continue;
 			XGetWindowAttributes(dpy, wins[j], &winattr);
 			if (!winattr.override_redirect && winattr.map_state == IsViewable)
 				make_new_client(wins[j], &screens[i]);
 		}
 		XFree(wins);
+		frame_pool_init(&screens[i]);
 		ewmh_init_screen(&screens[i]);
+#ifdef COMPOSITE
+		composite_init_screen(&screens[i]);
+#endif
 	}
 	ewmh_set_net_active_window(NULL);
+	restart_restore_finish();
 	LOG_LEAVE();
 }
 
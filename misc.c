@@ -7,7 +7,9 @@
 #include <stdarg.h>
 #include <signal.h>
 #include <string.h>
+#include <sys/select.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 #include "evilwm.h"
 #include "log.h"
@@ -15,6 +17,32 @@
 int need_client_tidy = 0;
 int ignore_xerror = 0;
 
+/* Milliseconds from some arbitrary point, unaffected by clock changes */
+unsigned long time_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Wait up to timeout milliseconds for something to read from the X
+ * server.  Returns true if there is. */
+int wait_for_x(long timeout) {
+	fd_set fds;
+	struct timeval tv;
+	int dpy_fd = ConnectionNumber(dpy);
+
+	XFlush(dpy);
+	if (XPending(dpy))
+		return 1;
+	if (timeout < 0)
+		timeout = 0;
+	FD_ZERO(&fds);
+	FD_SET(dpy_fd, &fds);
+	tv.tv_sec = timeout / 1000;
+	tv.tv_usec = (timeout % 1000) * 1000;
+	return select(dpy_fd + 1, &fds, NULL, NULL, &tv) > 0;
+}
+
 /* Now do this by fork()ing twice so we don't have to worry about SIGCHLDs */
 void spawn(const char *const cmd[]) {
 	ScreenInfo *current_screen = find_current_screen();
@@ -39,7 +67,12 @@ void spawn(const char *const cmd[]) {
 }
 
 void handle_signal(int signo) {
-	(void)signo;  /* unused */
+	if (signo == SIGHUP) {
+		wm_reload = 1;
+		return;
+	}
+	if (signo == SIGUSR1)
+		wm_restart = 1;
 	wm_exit = 1;
 }
 
@@ -79,6 +112,28 @@ int handle_xerror(Display *dsply, XErrorEvent *e) {
 	return 0;
 }
 
+/* Enter events caused by moving windows around are recognised by their
+ * serial number falling within the requests made to do so.  This avoids
+ * the XSync that discard_enter_events() needs.  A NoOp after the changes
+ * makes sure later crossings get a later serial. */
+static unsigned long ignore_enter_start = 0, ignore_enter_end = 0;
+static Window ignore_enter_except = None;
+
+void ignore_enter_events_begin(void) {
+	ignore_enter_start = NextRequest(dpy);
+}
+
+void ignore_enter_events_end(Client *except) {
+	ignore_enter_end = NextRequest(dpy);
+	XNoOp(dpy);
+	ignore_enter_except = except ? except->parent : None;
+}
+
+int is_ignored_enter(XCrossingEvent *e) {
+	return e->window != ignore_enter_except
+		&& e->serial - ignore_enter_start < ignore_enter_end - ignore_enter_start;
+}
+
 /* Remove all enter events from the queue except the last of any corresponding
  * to "except"s parent. */
 void discard_enter_events(Client *except) {
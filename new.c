@@ -56,8 +56,14 @@ void make_new_client(Window w, ScreenInfo *s) {
 		XFree(name);
 
 	window_type = ewmh_get_net_wm_window_type(w);
-	/* Don't manage DESKTOP type windows */
+	/* Don't manage DESKTOP type windows, just keep them at the bottom */
 	if (window_type & EWMH_WINDOW_TYPE_DESKTOP) {
+#ifdef VWM
+		if (has_vdesk_containers(s))
+			desktop_to_container(s, w);
+		else
+#endif
+		XLowerWindow(dpy, w);
 		XMapWindow(dpy, w);
 		XUngrabServer(dpy);
 		return;
@@ -77,7 +83,23 @@ void make_new_client(Window w, ScreenInfo *s) {
 
 	c->screen = s;
 	c->window = w;
+	c->parent = None;
 	c->ignore_unmap = 0;
+#ifdef VWM
+	c->container = s->root;
+	c->monitor = 0;
+#endif
+	c->hidden = 0;
+	c->parked = 0;
+	c->fullscreen = 0;
+	c->fs_monitors[0] = -1;
+	c->bypass_compositor = 0;
+	memset(c->strut, 0, sizeof(c->strut));
+	c->cmap_windows = NULL;
+	c->cmaps = NULL;
+	c->num_cmaps = 0;
+	c->ping_sent = c->kill_time = 0;
+	c->hung = 0;
 	c->remove = 0;
 
 	/* Ungrab the X server as soon as possible. Now that the client is
@@ -100,7 +122,9 @@ void make_new_client(Window w, ScreenInfo *s) {
 	}
 #endif
 
-	XSelectInput(dpy, c->window, ColormapChangeMask | EnterWindowMask | PropertyChangeMask);
+	XSelectInput(dpy, c->window, ClientEventMask);
+	c->ping_protocol = ewmh_get_net_wm_ping(c);
+	client_update_colormap_windows(c);
 
 	reparent(c);
 
@@ -150,13 +174,19 @@ void make_new_client(Window w, ScreenInfo *s) {
 		XFree(class);
 	}
 	ewmh_init_client(c);
-	ewmh_set_net_client_list(c->screen);
-	ewmh_set_net_client_list_stacking(c->screen);
+	ewmh_add_net_client_list(c);
+	client_update_strut(c);
+
+	/* Clients may ask to start fullscreen */
+	if (ewmh_has_net_wm_state(c->window, xa_net_wm_state_fullscreen))
+		fullscreen_client(c, NET_WM_STATE_ADD);
 
 	/* Only map the window frame (and thus the window) if it's supposed
-	 * to be visible on this virtual desktop. */
+	 * to be visible on this virtual desktop.  With vdesk containers,
+	 * the container decides that. */
 #ifdef VWM
-	if (is_fixed(c) || c->vdesk == s->vdesk)
+	client_to_container(c, 0);
+	if (on_visible_vdesk(c))
 #endif
 	{
 		client_show(c);
@@ -172,7 +202,9 @@ void make_new_client(Window w, ScreenInfo *s) {
 	}
 #ifdef VWM
 	else {
-		set_wm_state(c, IconicState);
+		if (has_vdesk_containers(s))
+			client_map_frame(c);
+		client_set_hidden(c, 1);
 	}
 	ewmh_set_net_wm_desktop(c);
 #endif
@@ -187,8 +219,10 @@ static void init_geometry(Client *c) {
 	unsigned long *eprop;
 	unsigned long nitems;
 	PropMwmHints *mprop;
+	int undecorated = 0;
 #ifdef VWM
 	unsigned long *lprop;
+	int have_vdesk = 0;
 #endif
 
 	if ( (mprop = get_property(c->window, mwm_hints, mwm_hints, &nitems)) ) {
@@ -197,9 +231,18 @@ static void init_geometry(Client *c) {
 				&& !(mprop->decorations & MWM_DECOR_ALL)
 				&& !(mprop->decorations & MWM_DECOR_BORDER)) {
 			c->border = 0;
+			undecorated = 1;
 		}
 		XFree(mprop);
 	}
+	/* Skip the frame for clients that asked not to be decorated (not
+	 * just any client, as with -bw 0) or, optionally, fullscreen ones */
+	if (opt_frameless && (undecorated || (opt_frameless > 1
+			&& ewmh_has_net_wm_state(c->window, xa_net_wm_state_fullscreen)))) {
+		LOG_DEBUG("managing without a frame\n");
+		c->border = 0;
+		c->parent = c->window;
+	}
 
 #ifdef VWM
 	c->vdesk = c->screen->vdesk;
@@ -208,6 +251,7 @@ static void init_geometry(Client *c) {
 		 * not be 32bits), it also sign extends the 32bit value */
 		if (nitems && valid_vdesk(lprop[0] & UINT32_MAX)) {
 			c->vdesk = lprop[0] & UINT32_MAX;
+			have_vdesk = 1;
 		}
 		XFree(lprop);
 	}
@@ -255,44 +299,159 @@ static void init_geometry(Client *c) {
 		c->x = attr.x;
 		c->y = attr.y;
 	} else {
-		int xmax = DisplayWidth(dpy, c->screen->screen);
-		int ymax = DisplayHeight(dpy, c->screen->screen);
+		/* Place relative to the pointer within its monitor */
+		Monitor *m;
 		int x, y;
-		get_mouse_position(&x, &y, c->screen->root);
-		c->x = (x * (xmax - c->border - c->width)) / xmax;
-		c->y = (y * (ymax - c->border - c->height)) / ymax;
+		get_pointer_position(c->screen, &x, &y);
+		m = find_monitor(c->screen, x, y);
+		c->x = m->wx + ((x - m->x) * (m->wwidth - c->border - c->width)) / m->width;
+		c->y = m->wy + ((y - m->y) * (m->wheight - c->border - c->height)) / m->height;
 		send_config(c);
 	}
 
 	LOG_DEBUG("window started as %dx%d +%d+%d\n", c->width, c->height, c->x, c->y);
-	if (attr.map_state == IsViewable) {
-		/* The reparent that is to come would trigger an unmap event */
+	if (attr.map_state == IsViewable && (!is_frameless(c)
+#ifdef VWM
+				|| has_vdesk_containers(c->screen)
+#endif
+				)) {
+		/* The reparent that is to come (into a frame, or for a
+		 * frameless client, a vdesk container) would trigger an
+		 * unmap event */
 		c->ignore_unmap++;
 	}
 	c->x += c->old_border;
 	c->y += c->old_border;
 	gravitate_border(c, -c->old_border);
 	gravitate_border(c, c->border);
+#ifdef VWM
+	/* Unless it asked for one, a new window opens on the desktop
+	 * showing on its monitor */
+	c->monitor = client_monitor(c) - c->screen->monitors;
+	if (!have_vdesk)
+		c->vdesk = monitor_vdesk(c->screen, c->monitor);
+#endif
 }
 
-static void reparent(Client *c) {
+static Window create_frame(ScreenInfo *s, int x, int y,
+		unsigned int width, unsigned int height, unsigned int border) {
 	XSetWindowAttributes p_attr;
+	Window frame;
 
-	p_attr.border_pixel = c->screen->bg.pixel;
+	p_attr.border_pixel = s->bg.pixel;
 	p_attr.override_redirect = True;
-	p_attr.event_mask = ChildMask | ButtonPressMask | EnterWindowMask;
-	c->parent = XCreateWindow(dpy, c->screen->root, c->x-c->border, c->y-c->border,
-		c->width, c->height, c->border,
-		DefaultDepth(dpy, c->screen->screen), CopyFromParent,
-		DefaultVisual(dpy, c->screen->screen),
+	p_attr.event_mask = FrameEventMask;
+	frame = XCreateWindow(dpy, s->root, x, y, width, height, border,
+		DefaultDepth(dpy, s->screen), CopyFromParent,
+		DefaultVisual(dpy, s->screen),
 		CWOverrideRedirect | CWBorderPixel | CWEventMask, &p_attr);
+	grab_frame_buttons(frame);
+	return frame;
+}
+
+/* Frame pool.  Short-lived windows would otherwise cost a frame
+ * creation, button grabs and a destroy each; instead, frames released
+ * by remove_client() are kept (unmapped and empty) and handed out again
+ * here, needing only to be moved and resized. */
+
+#ifdef DEBUG
+static unsigned long frame_pool_hits = 0;
+static unsigned long frame_pool_misses = 0;
+#endif
 
+void frame_pool_init(ScreenInfo *s) {
+	s->frame_pool = NULL;
+	s->frame_pool_size = s->frame_pool_count = 0;
+	if (opt_framepool <= 0)
+		return;
+	s->frame_pool = malloc(opt_framepool * sizeof(Window));
+	if (!s->frame_pool)
+		return;
+	s->frame_pool_size = opt_framepool;
+	while (s->frame_pool_count < s->frame_pool_size) {
+		s->frame_pool[s->frame_pool_count++] = create_frame(s, 0, 0, 1, 1, opt_bw);
+	}
+}
+
+void frame_pool_deinit(ScreenInfo *s) {
+	while (s->frame_pool_count > 0) {
+		XDestroyWindow(dpy, s->frame_pool[--s->frame_pool_count]);
+	}
+	free(s->frame_pool);
+	s->frame_pool = NULL;
+	s->frame_pool_size = 0;
+}
+
+/* Returns true if the frame was kept, otherwise the caller destroys it */
+int frame_pool_put(ScreenInfo *s, Window frame) {
+	if (s->frame_pool_count >= s->frame_pool_size) {
+		LOG_DEBUG("frame pool full, frame not kept\n");
+		return 0;
+	}
+	XUnmapWindow(dpy, frame);
+#ifdef VWM
+	if (has_vdesk_containers(s))
+		XReparentWindow(dpy, frame, s->root, 0, 0);
+#endif
+#ifdef SHAPE
+	if (have_shape)
+		XShapeCombineMask(dpy, frame, ShapeBounding, 0, 0, None, ShapeSet);
+#endif
+	s->frame_pool[s->frame_pool_count++] = frame;
+	return 1;
+}
+
+static Window frame_pool_get(Client *c) {
+	ScreenInfo *s = c->screen;
+	XWindowChanges wc;
+	Window frame;
+
+	if (s->frame_pool_count == 0) {
+#ifdef DEBUG
+		frame_pool_misses++;
+		LOG_DEBUG("frame pool miss (%lu hits, %lu misses)\n", frame_pool_hits, frame_pool_misses);
+#endif
+		return create_frame(s, frame_x(c), frame_y(c),
+				c->width, c->height, c->border);
+	}
+	frame = s->frame_pool[--s->frame_pool_count];
+#ifdef DEBUG
+	frame_pool_hits++;
+	LOG_DEBUG("frame pool hit (%lu hits, %lu misses)\n", frame_pool_hits, frame_pool_misses);
+#endif
+	/* A recycled frame keeps whatever stacking position it had; put it
+	 * on top, where a freshly created one would be */
+	wc.x = frame_x(c);
+	wc.y = frame_y(c);
+	wc.width = c->width;
+	wc.height = c->height;
+	wc.border_width = c->border;
+	wc.stack_mode = Above;
+	XConfigureWindow(dpy, frame, CWX|CWY|CWWidth|CWHeight|CWBorderWidth|CWStackMode, &wc);
+	XSetWindowBorder(dpy, frame, s->bg.pixel);
+	return frame;
+}
+
+static void reparent(Client *c) {
+	/* Frameless clients may be unmapped while hidden, or inside a vdesk
+	 * container, so they need to be in the save-set just the same */
 	XAddToSaveSet(dpy, c->window);
+	if (is_frameless(c)) {
+		XWindowChanges wc;
+		wc.x = c->x;
+		wc.y = c->y;
+		wc.width = c->width;
+		wc.height = c->height;
+		wc.border_width = 0;
+		XConfigureWindow(dpy, c->window, CWX|CWY|CWWidth|CWHeight|CWBorderWidth, &wc);
+		grab_frame_buttons(c->window);
+		return;
+	}
+	c->parent = frame_pool_get(c);
+
 	XSetWindowBorderWidth(dpy, c->window, 0);
 	XReparentWindow(dpy, c->window, c->parent, 0, 0);
 	XMapWindow(dpy, c->window);
-	grab_button(c->parent, grabmask2, AnyButton);
-	grab_button(c->parent, grabmask2 | altmask, AnyButton);
 }
 
 /* Get WM_NORMAL_HINTS property */
@@ -0,0 +1,550 @@
+/* evilwm - Minimalist Window Manager for X
+ * Copyright (C) 1999-2015 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+/* Restart in place.  The client table is written to an anonymous file
+ * which survives exec(), and the X server is asked to retain our frames
+ * when the old connection closes.  The new process then adopts those
+ * frames as they are, without reparenting anything or re-reading client
+ * properties. */
+
+#ifdef __linux__
+# define _GNU_SOURCE  /* memfd_create() */
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "evilwm.h"
+#include "log.h"
+
+#define STATE_FD_ENV  "EVILWM_STATE_FD"
+#define STATE_MAGIC   (0x4576696cUL)  /* "Evil" */
+#define STATE_VERSION (4)
+
+/* Colormap windows kept per client; a longer list is read again */
+#define STATE_CMAPS   (8)
+
+struct state_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t client_size;  /* sanity check on the record layout */
+	uint32_t num_screens;
+	uint32_t num_clients;
+	uint32_t current;  /* window of the focused client */
+};
+
+struct state_screen {
+	uint32_t vdesk, old_vdesk;
+	int32_t docks_visible;
+	int32_t current_monitor;
+	uint32_t monitor_vdesk[MAX_MONITORS], monitor_old_vdesk[MAX_MONITORS];
+};
+
+/* Clients are written in stacking order, bottom first. */
+struct state_client {
+	uint32_t window, parent;
+	uint32_t screen;
+	uint32_t vdesk;
+	uint32_t tab_order, mapping_order;
+	int32_t x, y, width, height, border;
+	int32_t oldx, oldy, oldw, oldh;
+	int32_t min_width, min_height, max_width, max_height;
+	int32_t width_inc, height_inc, base_width, base_height;
+	int32_t win_gravity_hint, win_gravity;
+	int32_t old_border;
+	int32_t is_dock;
+	int32_t fullscreen;
+	int32_t fs_oldx, fs_oldy, fs_oldw, fs_oldh, fs_oldborder;
+	int32_t fs_monitors[4];
+	int32_t bypass_compositor;
+	int32_t ping_protocol;
+	int32_t strut[12];
+	int32_t num_cmaps;  /* -1 if there were more than STATE_CMAPS */
+	uint32_t cmap_windows[STATE_CMAPS], cmaps[STATE_CMAPS];
+};
+
+static int state_fd = -1;
+
+/* State read back at startup */
+static struct state_header header;
+static struct state_screen *saved_screens = NULL;
+static struct state_client *saved_clients = NULL;
+static Client **restored = NULL;
+
+static int write_all(int fd, const void *buf, size_t count) {
+	const char *p = buf;
+	while (count > 0) {
+		ssize_t n = write(fd, p, count);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		count -= n;
+	}
+	return 0;
+}
+
+static int read_all(int fd, void *buf, size_t count) {
+	char *p = buf;
+	while (count > 0) {
+		ssize_t n = read(fd, p, count);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		count -= n;
+	}
+	return 0;
+}
+
+/* An anonymous file, deliberately not close-on-exec */
+static int open_state_file(void) {
+	FILE *tmp;
+	int fd;
+#ifdef MFD_CLOEXEC
+	fd = memfd_create("evilwm-state", 0);
+	if (fd >= 0)
+		return fd;
+#endif
+	tmp = tmpfile();
+	if (!tmp)
+		return -1;
+	fd = dup(fileno(tmp));
+	fclose(tmp);
+	return fd;
+}
+
+static uint32_t list_position(struct list *list, void *data) {
+	uint32_t i = 0;
+	for (; list; list = list->next, i++) {
+		if (list->data == data)
+			break;
+	}
+	return i;
+}
+
+/* Write the client table out.  Returns 0 on success. */
+int restart_save(void) {
+	struct state_header hdr;
+	struct list *iter;
+	int i, j;
+
+	LOG_ENTER("restart_save()");
+	if (state_fd >= 0)
+		close(state_fd);
+	state_fd = open_state_file();
+	if (state_fd < 0) {
+		LOG_ERROR("can't create state file for restart\n");
+		LOG_LEAVE();
+		return -1;
+	}
+
+	hdr.magic = STATE_MAGIC;
+	hdr.version = STATE_VERSION;
+	hdr.client_size = sizeof(struct state_client);
+	hdr.num_screens = num_screens;
+	hdr.num_clients = 0;
+	for (iter = clients_stacking_order; iter; iter = iter->next)
+		hdr.num_clients++;
+	hdr.current = current ? current->window : None;
+	if (write_all(state_fd, &hdr, sizeof(hdr)) < 0)
+		goto failed;
+
+	for (i = 0; i < num_screens; i++) {
+		struct state_screen ss;
+		memset(&ss, 0, sizeof(ss));
+#ifdef VWM
+		ss.vdesk = screens[i].vdesk;
+		ss.old_vdesk = screens[i].old_vdesk;
+		ss.current_monitor = screens[i].current_monitor;
+		for (j = 0; j < MAX_MONITORS; j++) {
+			ss.monitor_vdesk[j] = monitor_vdesk(&screens[i], j);
+			ss.monitor_old_vdesk[j] = opt_monitordesks
+				? screens[i].monitors[j].old_vdesk
+				: screens[i].old_vdesk;
+		}
+#endif
+		ss.docks_visible = screens[i].docks_visible;
+		if (write_all(state_fd, &ss, sizeof(ss)) < 0)
+			goto failed;
+	}
+
+	for (iter = clients_stacking_order; iter; iter = iter->next) {
+		Client *c = iter->data;
+		struct state_client sc;
+		memset(&sc, 0, sizeof(sc));
+		sc.window = c->window;
+		sc.parent = c->parent;
+		sc.screen = c->screen->screen;
+#ifdef VWM
+		sc.vdesk = c->vdesk;
+#endif
+		sc.tab_order = list_position(clients_tab_order, c);
+		sc.mapping_order = list_position(clients_mapping_order, c);
+		sc.x = c->x;
+		sc.y = c->y;
+		sc.width = c->width;
+		sc.height = c->height;
+		sc.border = c->border;
+		sc.oldx = c->oldx;
+		sc.oldy = c->oldy;
+		sc.oldw = c->oldw;
+		sc.oldh = c->oldh;
+		sc.min_width = c->min_width;
+		sc.min_height = c->min_height;
+		sc.max_width = c->max_width;
+		sc.max_height = c->max_height;
+		sc.width_inc = c->width_inc;
+		sc.height_inc = c->height_inc;
+		sc.base_width = c->base_width;
+		sc.base_height = c->base_height;
+		sc.win_gravity_hint = c->win_gravity_hint;
+		sc.win_gravity = c->win_gravity;
+		sc.old_border = c->old_border;
+		sc.is_dock = c->is_dock;
+		sc.fullscreen = c->fullscreen;
+		sc.fs_oldx = c->fs_oldx;
+		sc.fs_oldy = c->fs_oldy;
+		sc.fs_oldw = c->fs_oldw;
+		sc.fs_oldh = c->fs_oldh;
+		sc.fs_oldborder = c->fs_oldborder;
+		for (j = 0; j < 4; j++)
+			sc.fs_monitors[j] = c->fs_monitors[j];
+		sc.bypass_compositor = c->bypass_compositor;
+		sc.ping_protocol = c->ping_protocol;
+		for (j = 0; j < 12; j++)
+			sc.strut[j] = c->strut[j];
+		if (c->num_cmaps > STATE_CMAPS) {
+			sc.num_cmaps = -1;
+		} else {
+			sc.num_cmaps = c->num_cmaps;
+			for (j = 0; j < c->num_cmaps; j++) {
+				sc.cmap_windows[j] = c->cmap_windows[j];
+				sc.cmaps[j] = c->cmaps[j];
+			}
+		}
+		if (write_all(state_fd, &sc, sizeof(sc)) < 0)
+			goto failed;
+	}
+
+	if (lseek(state_fd, 0, SEEK_SET) < 0)
+		goto failed;
+	LOG_DEBUG("%u clients saved\n", (unsigned)hdr.num_clients);
+	LOG_LEAVE();
+	return 0;
+failed:
+	LOG_ERROR("failed to write state file for restart\n");
+	close(state_fd);
+	state_fd = -1;
+	LOG_LEAVE();
+	return -1;
+}
+
+/* Only returns if exec() failed. */
+void restart_exec(char *const argv[]) {
+	char buf[16];
+	snprintf(buf, sizeof(buf), "%d", state_fd);
+	setenv(STATE_FD_ENV, buf, 1);
+	execvp(argv[0], argv);
+	LOG_ERROR("restart failed: can't exec %s: %s\n", argv[0], strerror(errno));
+	unsetenv(STATE_FD_ENV);
+}
+
+/* Called early in setup_display().  Reads any state left for us by a
+ * previous process.  If none can be read but the X server is holding
+ * frames for us, have it release them: save-set processing will then
+ * put their clients back on the root window for normal adoption. */
+void restart_load(void) {
+	const char *env = getenv(STATE_FD_ENV);
+	size_t nbytes;
+
+	if (env) {
+		state_fd = atoi(env);
+		unsetenv(STATE_FD_ENV);
+	}
+	if (state_fd < 0)
+		return;
+	LOG_ENTER("restart_load(fd=%d)", state_fd);
+
+	if (read_all(state_fd, &header, sizeof(header)) < 0
+			|| header.magic != STATE_MAGIC
+			|| header.version != STATE_VERSION
+			|| header.client_size != sizeof(struct state_client)
+			|| header.num_screens != (uint32_t)ScreenCount(dpy))
+		goto failed;
+
+	nbytes = header.num_screens * sizeof(struct state_screen);
+	saved_screens = malloc(nbytes);
+	if (!saved_screens || read_all(state_fd, saved_screens, nbytes) < 0)
+		goto failed;
+	if (header.num_clients > 0) {
+		nbytes = header.num_clients * sizeof(struct state_client);
+		saved_clients = malloc(nbytes);
+		restored = calloc(header.num_clients, sizeof(Client *));
+		if (!saved_clients || !restored
+				|| read_all(state_fd, saved_clients, nbytes) < 0)
+			goto failed;
+	}
+	close(state_fd);
+	state_fd = -1;
+	LOG_DEBUG("%u clients to restore\n", (unsigned)header.num_clients);
+	LOG_LEAVE();
+	return;
+
+failed:
+	LOG_ERROR("can't read state from previous process, re-adopting windows\n");
+	close(state_fd);
+	state_fd = -1;
+	free(saved_screens);
+	free(saved_clients);
+	free(restored);
+	saved_screens = NULL;
+	saved_clients = NULL;
+	restored = NULL;
+	XKillClient(dpy, AllTemporary);
+	XSync(dpy, False);
+	LOG_LEAVE();
+}
+
+/* The colormap window list comes from the saved state, unless it was too
+ * long to fit.  The old process's selections went with its connection, so
+ * the listed windows need selecting on again. */
+static void restore_colormap_windows(Client *c, struct state_client *sc) {
+	int i;
+
+	if (sc->num_cmaps < 0) {
+		client_update_colormap_windows(c);
+		return;
+	}
+	if (sc->num_cmaps == 0)
+		return;
+	c->cmap_windows = malloc(sc->num_cmaps * sizeof(Window));
+	c->cmaps = malloc(sc->num_cmaps * sizeof(Colormap));
+	if (!c->cmap_windows || !c->cmaps) {
+		free(c->cmap_windows);
+		free(c->cmaps);
+		c->cmap_windows = NULL;
+		c->cmaps = NULL;
+		return;
+	}
+	for (i = 0; i < sc->num_cmaps; i++) {
+		c->cmap_windows[i] = sc->cmap_windows[i];
+		c->cmaps[i] = sc->cmaps[i];
+		if (c->cmap_windows[i] == c->window)
+			c->cmaps[i] = c->cmap;
+		else if (!find_client(c->cmap_windows[i]))
+			XSelectInput(dpy, c->cmap_windows[i], ColormapChangeMask);
+	}
+	c->num_cmaps = sc->num_cmaps;
+}
+
+/* Called for each screen before its windows are scanned.  Frames are
+ * override-redirect, so the scan would skip them anyway; their clients
+ * are set up here instead. */
+void restart_restore_screen(ScreenInfo *s) {
+	uint32_t i;
+	int j;
+
+	if (!saved_screens)
+		return;
+	LOG_ENTER("restart_restore_screen(screen=%d)", s->screen);
+#ifdef VWM
+	s->vdesk = saved_screens[s->screen].vdesk;
+	s->old_vdesk = saved_screens[s->screen].old_vdesk;
+	/* Monitors are matched by index; any that have appeared since
+	 * start on the screen's desktop */
+	for (i = 0; i < MAX_MONITORS; i++) {
+		s->monitors[i].vdesk = saved_screens[s->screen].monitor_vdesk[i];
+		s->monitors[i].old_vdesk = saved_screens[s->screen].monitor_old_vdesk[i];
+		if (i >= (uint32_t)s->num_monitors || !valid_vdesk(s->monitors[i].vdesk)) {
+			s->monitors[i].vdesk = s->vdesk;
+			s->monitors[i].old_vdesk = s->old_vdesk;
+		}
+	}
+	s->current_monitor = saved_screens[s->screen].current_monitor;
+	if (s->current_monitor < 0 || s->current_monitor >= s->num_monitors)
+		s->current_monitor = 0;
+#endif
+	s->docks_visible = saved_screens[s->screen].docks_visible;
+
+	for (i = 0; i < header.num_clients; i++) {
+		struct state_client *sc = &saved_clients[i];
+		XWindowAttributes attr;
+		Client *c;
+
+		if (sc->screen != (uint32_t)s->screen)
+			continue;
+		c = malloc(sizeof(Client));
+		if (!c) {
+			LOG_ERROR("out of memory in restart_restore_screen; limping onward\n");
+			break;
+		}
+		restored[i] = c;
+		c->window = sc->window;
+		c->parent = sc->parent;
+		c->screen = s;
+		c->ignore_unmap = 0;
+#ifdef VWM
+		c->container = s->root;
+		c->monitor = 0;
+#endif
+		c->hidden = 0;
+		c->parked = 0;
+		c->fullscreen = 0;
+		c->fs_monitors[0] = -1;
+		c->bypass_compositor = 0;
+		memset(c->strut, 0, sizeof(c->strut));
+		c->cmap_windows = NULL;
+		c->cmaps = NULL;
+		c->num_cmaps = 0;
+		c->ping_sent = c->kill_time = 0;
+		c->hung = 0;
+		c->remove = 0;
+		c->x = sc->x;
+		c->y = sc->y;
+		c->width = sc->width;
+		c->height = sc->height;
+		c->border = sc->border;
+		c->oldx = sc->oldx;
+		c->oldy = sc->oldy;
+		c->oldw = sc->oldw;
+		c->oldh = sc->oldh;
+		c->min_width = sc->min_width;
+		c->min_height = sc->min_height;
+		c->max_width = sc->max_width;
+		c->max_height = sc->max_height;
+		c->width_inc = sc->width_inc;
+		c->height_inc = sc->height_inc;
+		c->base_width = sc->base_width;
+		c->base_height = sc->base_height;
+		c->win_gravity_hint = sc->win_gravity_hint;
+		c->win_gravity = sc->win_gravity;
+		c->old_border = sc->old_border;
+		c->is_dock = sc->is_dock;
+		c->fullscreen = sc->fullscreen;
+		c->fs_oldx = sc->fs_oldx;
+		c->fs_oldy = sc->fs_oldy;
+		c->fs_oldw = sc->fs_oldw;
+		c->fs_oldh = sc->fs_oldh;
+		c->fs_oldborder = sc->fs_oldborder;
+		for (j = 0; j < 4; j++)
+			c->fs_monitors[j] = sc->fs_monitors[j];
+		c->bypass_compositor = sc->bypass_compositor;
+		c->ping_protocol = sc->ping_protocol;
+		for (j = 0; j < 12; j++)
+			c->strut[j] = sc->strut[j];
+#ifdef VWM
+		c->vdesk = sc->vdesk;
+#endif
+		clients_stacking_order = list_append(clients_stacking_order, c);
+		clients_tab_order = list_append(clients_tab_order, c);
+		clients_mapping_order = list_append(clients_mapping_order, c);
+
+		/* Client may have gone or withdrawn while nobody was managing
+		 * it.  Let the usual tidy up deal with that. */
+		c->cmap = DefaultColormap(dpy, s->screen);
+		/* (A frameless client is unmapped when just hidden.) */
+		if (!XGetWindowAttributes(dpy, c->window, &attr)
+				|| (attr.map_state == IsUnmapped && !is_frameless(c))) {
+			LOG_DEBUG("window %lx went away during restart\n", c->window);
+			c->remove = 1;
+			need_client_tidy = 1;
+		} else {
+			c->cmap = attr.colormap;
+			/* A hidden client whose window is still viewable was
+			 * parked by -park */
+#ifdef VWM
+			c->monitor = client_monitor(c) - s->monitors;
+			c->hidden = !on_visible_vdesk(c);
+#else
+			c->hidden = 0;
+#endif
+			if (c->is_dock && !s->docks_visible)
+				c->hidden = 1;
+			c->parked = c->hidden && attr.map_state == IsViewable;
+		}
+
+		if (!is_frameless(c))
+			XSelectInput(dpy, c->parent, FrameEventMask);
+		XAddToSaveSet(dpy, c->window);
+		XSelectInput(dpy, c->window, ClientEventMask);
+		if (c->remove)
+			memset(c->strut, 0, sizeof(c->strut));
+		if (has_strut(c))
+			s->struts = list_prepend(s->struts, c);
+		restore_colormap_windows(c, sc);
+		grab_frame_buttons(c->parent);
+#ifdef SHAPE
+		if (have_shape)
+			XShapeSelectInput(dpy, c->window, ShapeNotifyMask);
+#endif
+	}
+	/* Struts were restored above, so the work area only needs working
+	 * out once */
+	update_workarea(s);
+	LOG_LEAVE();
+}
+
+/* Put tab and mapping order back the way they were and refocus, once all
+ * screens have been set up. */
+void restart_restore_finish(void) {
+	struct list *tab = NULL, *mapping = NULL, *iter;
+	uint32_t i, j;
+	int k;
+
+	if (!saved_screens)
+		return;
+	LOG_ENTER("restart_restore_finish()");
+	for (j = 0; j < header.num_clients; j++) {
+		for (i = 0; i < header.num_clients; i++) {
+			if (restored[i] && saved_clients[i].tab_order == j)
+				tab = list_append(tab, restored[i]);
+			if (restored[i] && saved_clients[i].mapping_order == j)
+				mapping = list_append(mapping, restored[i]);
+		}
+	}
+	/* Anything that turned up during the restart goes after */
+	for (iter = clients_tab_order; iter; iter = iter->next) {
+		if (!list_find(tab, iter->data))
+			tab = list_append(tab, iter->data);
+	}
+	for (iter = clients_mapping_order; iter; iter = iter->next) {
+		if (!list_find(mapping, iter->data))
+			mapping = list_append(mapping, iter->data);
+	}
+	while (clients_tab_order)
+		clients_tab_order = list_delete(clients_tab_order, clients_tab_order->data);
+	while (clients_mapping_order)
+		clients_mapping_order = list_delete(clients_mapping_order, clients_mapping_order->data);
+	clients_tab_order = tab;
+	clients_mapping_order = mapping;
+
+	for (k = 0; k < num_screens; k++) {
+#ifdef VWM
+		ewmh_set_net_current_desktop(&screens[k]);
+#endif
+		ewmh_set_net_client_list(&screens[k]);
+		ewmh_set_net_client_list_stacking(&screens[k]);
+	}
+	if (header.current != None) {
+		Client *c = find_client(header.current);
+		if (c && !c->remove)
+			select_client(c);
+	}
+
+	free(saved_screens);
+	free(saved_clients);
+	free(restored);
+	saved_screens = NULL;
+	saved_clients = NULL;
+	restored = NULL;
+	LOG_LEAVE();
+}
@@ -16,80 +16,474 @@ static void update_info_window(Client *c);
 static void remove_info_window(void);
 static void grab_keysym(Window w, unsigned int mask, KeySym keysym);
 
+/* The banner is rendered into a pixmap used as the window background,
+ * and only redrawn when its text changes.  The title and its width are
+ * fetched once per banner.  Following a moving window is then just an
+ * XMoveWindow. */
+static char *info_name = NULL;
+static int info_namew;
+static char info_text[27];
+static Pixmap info_pixmap = None;
+static GC info_gc = None;
+static int info_x, info_y, info_w, info_h;
+
 static void create_info_window(Client *c) {
-	info_window = XCreateSimpleWindow(dpy, c->screen->root, -4, -4, 2, 2,
-			0, c->screen->fg.pixel, c->screen->fg.pixel);
-	XMapRaised(dpy, info_window);
+	XSetWindowAttributes attr;
+	XGCValues gv;
+
+	attr.override_redirect = True;
+	attr.background_pixel = c->screen->fg.pixel;
+	attr.save_under = True;
+	attr.backing_store = WhenMapped;
+	info_window = XCreateWindow(dpy, c->screen->root, -4, -4, 2, 2, 0,
+			CopyFromParent, InputOutput, CopyFromParent,
+			CWOverrideRedirect | CWBackPixel | CWSaveUnder | CWBackingStore,
+			&attr);
+	gv.foreground = c->screen->fg.pixel;
+	info_gc = XCreateGC(dpy, info_window, GCForeground, &gv);
+	XFetchName(dpy, c->window, &info_name);
+	if (info_name)
+		info_namew = XTextWidth(font, info_name, strlen(info_name));
+	info_text[0] = 0;
+	info_x = info_y = -4;
+	info_w = info_h = 0;
 	update_info_window(c);
+	XMapRaised(dpy, info_window);
+}
+
+static void draw_info_pixmap(Client *c, int w, int h) {
+	if (w != info_w || h != info_h) {
+		if (info_pixmap)
+			XFreePixmap(dpy, info_pixmap);
+		info_pixmap = XCreatePixmap(dpy, info_window, w, h,
+				DefaultDepth(dpy, c->screen->screen));
+	}
+	XFillRectangle(dpy, info_pixmap, info_gc, 0, 0, w, h);
+	if (info_name) {
+		XDrawString(dpy, info_pixmap, c->screen->invert_gc,
+				1, h / 2 - 1, info_name, strlen(info_name));
+	}
+	XDrawString(dpy, info_pixmap, c->screen->invert_gc, 1, h - 1,
+			info_text, strlen(info_text));
+	XSetWindowBackgroundPixmap(dpy, info_window, info_pixmap);
 }
 
 static void update_info_window(Client *c) {
-	char *name;
-	char buf[27];
-	int namew, iwinx, iwiny, iwinw, iwinh;
+	char buf[sizeof(info_text)];
+	int iwinx, iwiny, iwinw = info_w, iwinh = info_h;
 	int width_inc = c->width_inc, height_inc = c->height_inc;
+	int redraw;
+	Monitor *m;
 
 	if (!info_window)
 		return;
 	snprintf(buf, sizeof(buf), "%dx%d+%d+%d", (c->width-c->base_width)/width_inc,
 		(c->height-c->base_height)/height_inc, c->x, c->y);
-	iwinw = XTextWidth(font, buf, strlen(buf)) + 2;
-	iwinh = font->max_bounds.ascent + font->max_bounds.descent;
-	XFetchName(dpy, c->window, &name);
-	if (name) {
-		namew = XTextWidth(font, name, strlen(name));
-		if (namew > iwinw)
-			iwinw = namew + 2;
-		iwinh = iwinh * 2;
+	redraw = strcmp(buf, info_text) != 0;
+	if (redraw) {
+		strcpy(info_text, buf);
+		iwinw = XTextWidth(font, buf, strlen(buf)) + 2;
+		iwinh = font->max_bounds.ascent + font->max_bounds.descent;
+		if (info_name) {
+			if (info_namew > iwinw)
+				iwinw = info_namew + 2;
+			iwinh = iwinh * 2;
+		}
+		draw_info_pixmap(c, iwinw, iwinh);
 	}
 	iwinx = c->x + c->border + c->width - iwinw;
 	iwiny = c->y - c->border;
-	if (iwinx + iwinw > DisplayWidth(dpy, c->screen->screen))
-		iwinx = DisplayWidth(dpy, c->screen->screen) - iwinw;
-	if (iwinx < 0)
-		iwinx = 0;
-	if (iwiny + iwinh > DisplayHeight(dpy, c->screen->screen))
-		iwiny = DisplayHeight(dpy, c->screen->screen) - iwinh;
-	if (iwiny < 0)
-		iwiny = 0;
-	XMoveResizeWindow(dpy, info_window, iwinx, iwiny, iwinw, iwinh);
-	XClearWindow(dpy, info_window);
-	if (name) {
-		XDrawString(dpy, info_window, c->screen->invert_gc,
-				1, iwinh / 2 - 1, name, strlen(name));
-		XFree(name);
-	}
-	XDrawString(dpy, info_window, c->screen->invert_gc, 1, iwinh - 1,
-			buf, strlen(buf));
+	m = client_monitor(c);
+	if (iwinx + iwinw > m->x + m->width)
+		iwinx = m->x + m->width - iwinw;
+	if (iwinx < m->x)
+		iwinx = m->x;
+	if (iwiny + iwinh > m->y + m->height)
+		iwiny = m->y + m->height - iwinh;
+	if (iwiny < m->y)
+		iwiny = m->y;
+	if (iwinw != info_w || iwinh != info_h) {
+		XMoveResizeWindow(dpy, info_window, iwinx, iwiny, iwinw, iwinh);
+		info_w = iwinw;
+		info_h = iwinh;
+	} else if (iwinx != info_x || iwiny != info_y) {
+		XMoveWindow(dpy, info_window, iwinx, iwiny);
+	}
+	info_x = iwinx;
+	info_y = iwiny;
+	/* New background only shows once the window is cleared */
+	if (redraw)
+		XClearWindow(dpy, info_window);
 }
 
 static void remove_info_window(void) {
 	if (info_window)
 		XDestroyWindow(dpy, info_window);
 	info_window = None;
+	if (info_pixmap)
+		XFreePixmap(dpy, info_pixmap);
+	info_pixmap = None;
+	if (info_gc)
+		XFreeGC(dpy, info_gc);
+	info_gc = None;
+	if (info_name)
+		XFree(info_name);
+	info_name = NULL;
 }
 #endif  /* INFOBANNER */
 
-static void draw_outline(Client *c) {
+/* The outline shown while sweeping (or dragging without solid drag) is
+ * made of thin override-redirect windows rather than drawn inverted on the
+ * root window.  That way it can't be damaged by other clients, so there's
+ * no need to hold a server grab (and XSync on every motion event) to keep
+ * it intact. */
+static Window outline_edges[4];
+#ifndef INFOBANNER_MOVERESIZE
+static Window outline_label = None;
+#endif
+
+static Window create_outline_window(Client *c) {
+	XSetWindowAttributes attr;
+	attr.override_redirect = True;
+	attr.background_pixel = c->screen->fg.pixel;
+	attr.save_under = True;
+	return XCreateWindow(dpy, c->screen->root, -1, -1, 1, 1, 0,
+			CopyFromParent, InputOutput, CopyFromParent,
+			CWOverrideRedirect | CWBackPixel | CWSaveUnder, &attr);
+}
+
+static void update_outline(Client *c) {
+	int x = c->x - c->border;
+	int y = c->y - c->border;
+	int w = c->width + 2*c->border;
+	int h = c->height + 2*c->border;
 #ifndef INFOBANNER_MOVERESIZE
 	char buf[27];
 	int width_inc = c->width_inc, height_inc = c->height_inc;
+	int labelw, labelh;
 #endif  /* ndef INFOBANNER_MOVERESIZE */
 
-	XDrawRectangle(dpy, c->screen->root, c->screen->invert_gc,
-		c->x - c->border, c->y - c->border,
-		c->width + 2*c->border-1, c->height + 2*c->border-1);
+	XMoveResizeWindow(dpy, outline_edges[0], x, y, w, 1);
+	XMoveResizeWindow(dpy, outline_edges[1], x, y + h - 1, w, 1);
+	XMoveResizeWindow(dpy, outline_edges[2], x, y, 1, h);
+	XMoveResizeWindow(dpy, outline_edges[3], x + w - 1, y, 1, h);
 
 #ifndef INFOBANNER_MOVERESIZE
 	snprintf(buf, sizeof(buf), "%dx%d+%d+%d", (c->width-c->base_width)/width_inc,
 			(c->height-c->base_height)/height_inc, c->x, c->y);
-	XDrawString(dpy, c->screen->root, c->screen->invert_gc,
-		c->x + c->width - XTextWidth(font, buf, strlen(buf)) - SPACE,
-		c->y + c->height - SPACE,
-		buf, strlen(buf));
+	labelw = XTextWidth(font, buf, strlen(buf)) + 2;
+	labelh = font->max_bounds.ascent + font->max_bounds.descent;
+	XMoveResizeWindow(dpy, outline_label,
+			c->x + c->width - labelw - SPACE,
+			c->y + c->height - labelh - SPACE,
+			labelw, labelh);
+	XClearWindow(dpy, outline_label);
+	XDrawString(dpy, outline_label, c->screen->invert_gc,
+			1, font->max_bounds.ascent, buf, strlen(buf));
 #endif  /* ndef INFOBANNER_MOVERESIZE */
 }
 
+static void create_outline(Client *c) {
+	int i;
+	for (i = 0; i < 4; i++)
+		outline_edges[i] = create_outline_window(c);
+#ifndef INFOBANNER_MOVERESIZE
+	outline_label = create_outline_window(c);
+	XMapRaised(dpy, outline_label);
+#endif
+	for (i = 0; i < 4; i++)
+		XMapRaised(dpy, outline_edges[i]);
+	update_outline(c);
+}
+
+static void remove_outline(void) {
+	int i;
+	for (i = 0; i < 4; i++) {
+		XDestroyWindow(dpy, outline_edges[i]);
+		outline_edges[i] = None;
+	}
+#ifndef INFOBANNER_MOVERESIZE
+	XDestroyWindow(dpy, outline_label);
+	outline_label = None;
+#endif
+}
+
+/* Moves and resizes track the pointer through XInput2 where possible.
+ * Positions are kept as doubles, so subpixel movement isn't lost to
+ * rounding.  With XI 2.1, raw motion also arrives straight from the
+ * device, at its own rate and without motion compression.  The deltas
+ * used are the accelerated ones, so windows stay with the cursor, and
+ * each ordinary motion event puts the position back where the server has
+ * the cursor.  Everything is handed on as core events, so the loops below
+ * needn't care which they got; drag() asks mouse_offset() for the
+ * subpixel movement. */
+#ifdef XINPUT2
+static int xi2_device = -1;  /* master pointer grabbed through XI2 */
+static Window xi2_root;
+static int xi2_width, xi2_height;  /* root size, to clamp raw motion */
+static double xi2_x, xi2_y;  /* pointer position */
+static double xi2_start_x, xi2_start_y;  /* ... when grabbed */
+static int xi2_core_x, xi2_core_y, xi2_core_dx, xi2_core_dy;  /* last handed on */
+static unsigned int xi2_state;  /* modifiers from the last device event */
+static int xi2_source = -1, xi2_source_relative;  /* last raw motion source */
+
+static int xi2_round(double d) {
+	return d < 0 ? -(int)(-d + 0.5) : (int)(d + 0.5);
+}
+
+static int is_xi2_event(XEvent *ev) {
+	return ev->type == GenericEvent && ev->xcookie.extension == xi2_opcode;
+}
+
+/* Raw events from absolute devices (tablets) carry device coordinates,
+ * not deltas, so only relative ones are used.  The answer for the last
+ * source device is kept, as it rarely changes. */
+static int xi2_is_relative(int sourceid) {
+	XIDeviceInfo *info;
+	int n, i;
+
+	if (sourceid == xi2_source)
+		return xi2_source_relative;
+	xi2_source = sourceid;
+	xi2_source_relative = 0;
+	info = XIQueryDevice(dpy, sourceid, &n);
+	if (!info)
+		return 0;
+	for (i = 0; i < info->num_classes; i++) {
+		XIValuatorClassInfo *v = (XIValuatorClassInfo *)info->classes[i];
+		if (v->type == XIValuatorClass && v->number == 0)
+			xi2_source_relative = (v->mode == XIModeRelative);
+	}
+	XIFreeDeviceInfo(info);
+	return xi2_source_relative;
+}
+
+/* Add a raw motion event's X and Y deltas to the pointer position.
+ * Returns false if it had none. */
+static int xi2_raw_motion(XIRawEvent *re) {
+	double d[2] = { 0.0, 0.0 };
+	int i, v = 0;
+
+	if (re->deviceid != xi2_device || !xi2_is_relative(re->sourceid))
+		return 0;
+	/* Values are only present for valuators set in the mask */
+	for (i = 0; i < 2 && i < re->valuators.mask_len * 8; i++) {
+		if (XIMaskIsSet(re->valuators.mask, i))
+			d[i] = re->valuators.values[v++];
+	}
+	if (v == 0)
+		return 0;
+	xi2_x += d[0];
+	xi2_y += d[1];
+	if (xi2_x < 0) xi2_x = 0;
+	if (xi2_x > xi2_width - 1) xi2_x = xi2_width - 1;
+	if (xi2_y < 0) xi2_y = 0;
+	if (xi2_y > xi2_height - 1) xi2_y = xi2_height - 1;
+	return 1;
+}
+
+/* Rewrite an XI2 event as the core equivalent.  Returns false if there's
+ * nothing to handle, including motion too small to change any position. */
+static int xi2_to_core(XEvent *ev) {
+	XIDeviceEvent *de;
+	XEvent core;
+	int ok = 1, dx, dy;
+
+	if (!XGetEventData(dpy, &ev->xcookie))
+		return 0;
+	de = ev->xcookie.data;
+	memset(&core, 0, sizeof(core));
+	switch (de->evtype) {
+		case XI_RawMotion:
+			ok = xi2_raw_motion(ev->xcookie.data);
+			core.type = MotionNotify;
+			core.xmotion.time = ((XIRawEvent *)ev->xcookie.data)->time;
+			break;
+		case XI_Motion:
+		case XI_ButtonPress:
+		case XI_ButtonRelease:
+			xi2_x = de->root_x;
+			xi2_y = de->root_y;
+			xi2_state = de->mods.effective;
+			core.xbutton.time = de->time;
+			if (de->evtype == XI_Motion) {
+				core.type = MotionNotify;
+			} else {
+				core.type = de->evtype == XI_ButtonPress ? ButtonPress : ButtonRelease;
+				core.xbutton.button = de->detail;
+			}
+			break;
+		default:
+			ok = 0;
+			break;
+	}
+	XFreeEventData(dpy, &ev->xcookie);
+	if (!ok)
+		return 0;
+	/* Motion and button events share their layout up to here */
+	core.xbutton.window = core.xbutton.root = xi2_root;
+	core.xbutton.x = core.xbutton.x_root = xi2_round(xi2_x);
+	core.xbutton.y = core.xbutton.y_root = xi2_round(xi2_y);
+	core.xbutton.state = xi2_state;
+	core.xbutton.same_screen = True;
+	dx = xi2_round(xi2_x - xi2_start_x);
+	dy = xi2_round(xi2_y - xi2_start_y);
+	if (core.type == MotionNotify && core.xmotion.x == xi2_core_x
+			&& core.xmotion.y == xi2_core_y
+			&& dx == xi2_core_dx && dy == xi2_core_dy)
+		return 0;
+	xi2_core_x = core.xmotion.x;
+	xi2_core_y = core.xmotion.y;
+	xi2_core_dx = dx;
+	xi2_core_dy = dy;
+	*ev = core;
+	return 1;
+}
+
+static int xi2_grab(ScreenInfo *s, Cursor cursor) {
+	unsigned char bits[XIMaskLen(XI_LASTEVENT)];
+	XIEventMask mask;
+	XIButtonState buttons;
+	XIModifierState mods;
+	XIGroupState group;
+	Window root, child;
+	double wx, wy;
+	int device;
+
+	if (!XIGetClientPointer(dpy, None, &device))
+		return 0;
+	memset(bits, 0, sizeof(bits));
+	XISetMask(bits, XI_Motion);
+	XISetMask(bits, XI_ButtonPress);
+	XISetMask(bits, XI_ButtonRelease);
+	mask.deviceid = device;
+	mask.mask_len = sizeof(bits);
+	mask.mask = bits;
+	if (XIGrabDevice(dpy, device, s->root, CurrentTime, cursor,
+			XIGrabModeAsync, XIGrabModeAsync, False, &mask) != GrabSuccess)
+		return 0;
+	if (!XIQueryPointer(dpy, device, s->root, &root, &child, &xi2_x, &xi2_y,
+			&wx, &wy, &buttons, &mods, &group)) {
+		XIUngrabDevice(dpy, device, CurrentTime);
+		return 0;
+	}
+	XFree(buttons.mask);
+	xi2_state = mods.effective;
+	xi2_start_x = xi2_x;
+	xi2_start_y = xi2_y;
+	xi2_core_x = xi2_round(xi2_x);
+	xi2_core_y = xi2_round(xi2_y);
+	xi2_core_dx = xi2_core_dy = 0;
+	xi2_root = s->root;
+	xi2_width = DisplayWidth(dpy, s->screen);
+	xi2_height = DisplayHeight(dpy, s->screen);
+	/* Raw events aren't subject to the grab, but from XI 2.1 are still
+	 * delivered to a root window selection while it's active */
+	if (have_xi2_raw) {
+		memset(bits, 0, sizeof(bits));
+		XISetMask(bits, XI_RawMotion);
+		XISelectEvents(dpy, s->root, &mask, 1);
+	}
+	xi2_device = device;
+	return 1;
+}
+
+static void xi2_ungrab(void) {
+	if (have_xi2_raw) {
+		unsigned char bits[XIMaskLen(XI_LASTEVENT)];
+		XIEventMask mask;
+		memset(bits, 0, sizeof(bits));
+		mask.deviceid = xi2_device;
+		mask.mask_len = sizeof(bits);
+		mask.mask = bits;
+		XISelectEvents(dpy, xi2_root, &mask, 1);
+	}
+	XIUngrabDevice(dpy, xi2_device, CurrentTime);
+	xi2_device = -1;
+}
+#endif
+
+static int grab_mouse(ScreenInfo *s, Cursor cursor) {
+#ifdef XINPUT2
+	if (have_xi2) {
+		if (xi2_grab(s, cursor))
+			return 1;
+		LOG_DEBUG("XI2 grab failed, using core pointer\n");
+	}
+#endif
+	return grab_pointer(s->root, MouseMask, cursor);
+}
+
+static void ungrab_mouse(void) {
+#ifdef XINPUT2
+	if (xi2_device >= 0) {
+		xi2_ungrab();
+		return;
+	}
+#endif
+	XUngrabPointer(dpy, CurrentTime);
+}
+
+/* How far the pointer has moved since (x1,y1), where it was when grabbed */
+static void mouse_offset(XMotionEvent *e, int x1, int y1, int *dx, int *dy) {
+#ifdef XINPUT2
+	if (xi2_device >= 0) {
+		*dx = xi2_round(xi2_x - xi2_start_x);
+		*dy = xi2_round(xi2_y - xi2_start_y);
+		return;
+	}
+#endif
+	*dx = e->x - x1;
+	*dy = e->y - y1;
+}
+
+static Bool is_mouse_event(Display *dummy, XEvent *ev, XPointer arg) {
+	(void)dummy;
+	(void)arg;
+	if (ev->type == MotionNotify || ev->type == ButtonPress
+			|| ev->type == ButtonRelease)
+		return True;
+#ifdef XINPUT2
+	if (xi2_device >= 0 && is_xi2_event(ev))
+		return True;
+#endif
+#ifdef COMPOSITE
+	/* Taken so that the screen is repainted during the operation */
+	if (is_composite_event(ev))
+		return True;
+#endif
+	return False;
+}
+
+/* Fetch the next pointer event during a move or resize, waiting for one
+ * if block is set.  Returns false if none was available. */
+static int get_mouse_event(XEvent *ev, int block) {
+	for (;;) {
+#ifdef COMPOSITE
+		if (!XCheckIfEvent(dpy, ev, is_mouse_event, NULL)) {
+			composite_paint();
+			if (!block)
+				return 0;
+			XIfEvent(dpy, ev, is_mouse_event, NULL);
+		}
+		if (is_composite_event(ev)) {
+			composite_handle_event(ev);
+			continue;
+		}
+#else
+		if (block)
+			XIfEvent(dpy, ev, is_mouse_event, NULL);
+		else if (!XCheckIfEvent(dpy, ev, is_mouse_event, NULL))
+			return 0;
+#endif
+#ifdef XINPUT2
+		if (is_xi2_event(ev) && !xi2_to_core(ev))
+			continue;
+#endif
+		return 1;
+	}
+}
+
 static void recalculate_sweep(Client *c, int x1, int y1, int x2, int y2, unsigned force) {
 	if (force || c->oldw == 0) {
 		c->oldw = 0;
@@ -113,44 +507,254 @@ static void recalculate_sweep(Client *c, int x1, int y1, int x2, int y2, unsigne
 	}
 }
 
+/* Ask RandR for the refresh rate of the CRTC showing (x,y).  This costs
+ * a round trip per CRTC, so refresh_rate() caches it per monitor. */
+static int query_refresh_rate(ScreenInfo *s, int x, int y) {
+	int rate = 0;
+#ifdef RANDR
+	XRRScreenResources *res;
+	int i, j;
+
+	if (!have_randr)
+		return DEF_DRAGRATE;
+	res = XRRGetScreenResourcesCurrent(dpy, s->root);
+	if (!res)
+		return DEF_DRAGRATE;
+	for (i = 0; i < res->ncrtc && !rate; i++) {
+		XRRCrtcInfo *crtc = XRRGetCrtcInfo(dpy, res, res->crtcs[i]);
+		if (!crtc)
+			continue;
+		if (crtc->mode != None && x >= crtc->x && y >= crtc->y
+				&& x < crtc->x + (int)crtc->width
+				&& y < crtc->y + (int)crtc->height) {
+			for (j = 0; j < res->nmode; j++) {
+				XRRModeInfo *m = &res->modes[j];
+				double vtotal = m->vTotal;
+				if (m->id != crtc->mode)
+					continue;
+				if (m->modeFlags & RR_DoubleScan)
+					vtotal *= 2;
+				if (m->modeFlags & RR_Interlace)
+					vtotal /= 2;
+				if (m->hTotal && vtotal > 0)
+					rate = m->dotClock / (m->hTotal * vtotal) + 0.5;
+				break;
+			}
+		}
+		XRRFreeCrtcInfo(crtc);
+	}
+	XRRFreeScreenResources(res);
+#else
+	(void)s; (void)x; (void)y;
+#endif
+	return rate > 0 ? rate : DEF_DRAGRATE;
+}
+
+/* Refresh rate of the monitor under (x,y), for pacing solid moves and
+ * resizes.  update_monitors() forgets the cached rates whenever RandR
+ * reports a change. */
+static int refresh_rate(ScreenInfo *s, int x, int y) {
+	Monitor *m = find_monitor(s, x, y);
+	if (!m->refresh)
+		m->refresh = query_refresh_rate(s, m->x + m->width / 2,
+				m->y + m->height / 2);
+	return m->refresh;
+}
+
+/* Resize without raising or telling the client - used during a sweep */
+static void resize_frame(Client *c) {
+	XMoveResizeWindow(dpy, c->parent, frame_x(c), frame_y(c),
+			c->width, c->height);
+	if (!is_frameless(c))
+		XMoveResizeWindow(dpy, c->window, 0, 0, c->width, c->height);
+}
+
+static Bool is_sweep_event(Display *d, XEvent *ev, XPointer arg) {
+	if (is_mouse_event(d, ev, arg))
+		return True;
+#ifdef SYNC
+	if (have_sync && ev->type == sync_event_base + XSyncAlarmNotify)
+		return True;
+#endif
+	return False;
+}
+
+/* Opaque sweep.  A new size is only applied once the client has dealt with
+ * the last one.  For clients supporting _NET_WM_SYNC_REQUEST, that's when
+ * they update their sync counter; otherwise it's at most once per display
+ * refresh.  Either way, slow clients just get fewer, larger steps. */
+static void sweep_solid(Client *c, int old_cx, int old_cy) {
+	XEvent ev;
+	unsigned long interval, last_resize = 0;
+	int pending = 0, awaiting = 0;
+#ifdef DEBUG
+	unsigned long start = time_ms();
+	unsigned long nresizes = 0;
+#endif
+#ifdef SYNC
+	XSyncCounter counter = ewmh_get_net_wm_sync_request_counter(c);
+	XSyncAlarm alarm = None;
+	XSyncAlarmAttributes aa;
+	unsigned long sent = 0;
+
+	if (counter != None && XSyncQueryCounter(dpy, counter, &aa.trigger.wait_value)) {
+		aa.trigger.counter = counter;
+		aa.trigger.value_type = XSyncAbsolute;
+		aa.trigger.test_type = XSyncPositiveComparison;
+		aa.events = True;
+		alarm = XSyncCreateAlarm(dpy, XSyncCACounter | XSyncCAValueType
+				| XSyncCAValue | XSyncCATestType | XSyncCAEvents, &aa);
+	}
+	if (alarm == None)
+		counter = None;
+	LOG_DEBUG("sweep: %s sync counter\n", counter != None ? "using" : "no");
+#endif
+	interval = 1000 / (opt_dragrate > 0 ? opt_dragrate : refresh_rate(c->screen, c->x, c->y));
+
+	for (;;) {
+		unsigned long now = time_ms();
+#ifdef SYNC
+		if (awaiting && now - sent >= SYNC_TIMEOUT) {
+			LOG_DEBUG("sweep: sync request timed out, not waiting any more\n");
+			awaiting = 0;
+			counter = None;
+		}
+		if (pending && !awaiting && counter != None) {
+			XSyncValue one;
+			int overflow;
+			XSyncIntToValue(&one, 1);
+			XSyncValueAdd(&aa.trigger.wait_value, aa.trigger.wait_value, one, &overflow);
+			XSyncChangeAlarm(dpy, alarm, XSyncCAValue, &aa);
+			ewmh_send_net_wm_sync_request(c, aa.trigger.wait_value);
+			resize_frame(c);
+			pending = 0;
+			awaiting = 1;
+			sent = now;
+# ifdef DEBUG
+			nresizes++;
+# endif
+		}
+#endif
+		if (pending && !awaiting && now - last_resize >= interval) {
+			resize_frame(c);
+			pending = 0;
+			last_resize = now;
+#ifdef DEBUG
+			nresizes++;
+#endif
+		}
+		if (pending || awaiting) {
+			if (!XCheckIfEvent(dpy, &ev, is_sweep_event, NULL)) {
+				long wait = interval - (long)(now - last_resize);
+#ifdef SYNC
+				if (awaiting)
+					wait = SYNC_TIMEOUT - (long)(now - sent);
+#endif
+#ifdef COMPOSITE
+				composite_paint();
+#endif
+				wait_for_x(wait);
+				continue;
+			}
+		} else if (!XCheckIfEvent(dpy, &ev, is_sweep_event, NULL)) {
+#ifdef COMPOSITE
+			composite_paint();
+#endif
+			XIfEvent(dpy, &ev, is_sweep_event, NULL);
+		}
+#ifdef COMPOSITE
+		if (is_composite_event(&ev)) {
+			composite_handle_event(&ev);
+			continue;
+		}
+#endif
+#ifdef XINPUT2
+		if (is_xi2_event(&ev) && !xi2_to_core(&ev))
+			continue;
+#endif
+		switch (ev.type) {
+			case MotionNotify:
+				if (ev.xmotion.root != c->screen->root)
+					break;
+				note_pointer_position(ev.xmotion.root, ev.xmotion.x, ev.xmotion.y);
+				recalculate_sweep(c, old_cx, old_cy, ev.xmotion.x, ev.xmotion.y, ev.xmotion.state & altmask);
+#ifdef INFOBANNER_MOVERESIZE
+				update_info_window(c);
+#endif
+				pending = 1;
+				break;
+			case ButtonRelease:
+#ifdef SYNC
+				if (alarm != None)
+					XSyncDestroyAlarm(dpy, alarm);
+#endif
+#ifdef INFOBANNER_MOVERESIZE
+				remove_info_window();
+#endif
+				ungrab_mouse();
+				moveresize(c);
+				/* In case maximise state has changed: */
+				ewmh_set_net_wm_state(c);
+#ifdef DEBUG
+				{
+					unsigned long elapsed = time_ms() - start;
+					if (elapsed == 0) elapsed = 1;
+					LOG_DEBUG("sweep: %lu resizes (%lu/s) in %lums\n",
+							nresizes, nresizes * 1000 / elapsed, elapsed);
+				}
+#endif
+				return;
+			default:
+#ifdef SYNC
+				if (have_sync && ev.type == sync_event_base + XSyncAlarmNotify) {
+					XSyncAlarmNotifyEvent *ae = (XSyncAlarmNotifyEvent *)&ev;
+					if (ae->alarm == alarm && !XSyncValueLessThan(ae->counter_value, aa.trigger.wait_value))
+						awaiting = 0;
+				}
+#endif
+				break;
+		}
+	}
+}
+
 void sweep(Client *c) {
 	XEvent ev;
 	int old_cx = c->x;
 	int old_cy = c->y;
 
-	if (!grab_pointer(c->screen->root, MouseMask, resize_curs)) return;
+	if (!grab_mouse(c->screen, resize_curs)) return;
 
 	client_raise(c);
 #ifdef INFOBANNER_MOVERESIZE
 	create_info_window(c);
 #endif
-	XGrabServer(dpy);
-	draw_outline(c);
+	if (opt_solidsweep) {
+		setmouse(c->window, c->width, c->height);
+		sweep_solid(c, old_cx, old_cy);
+		return;
+	}
+	create_outline(c);
 
 	setmouse(c->window, c->width, c->height);
 	for (;;) {
-		XMaskEvent(dpy, MouseMask, &ev);
+		get_mouse_event(&ev, 1);
 		switch (ev.type) {
 			case MotionNotify:
 				if (ev.xmotion.root != c->screen->root)
 					break;
-				draw_outline(c); /* clear */
-				XUngrabServer(dpy);
+				note_pointer_position(ev.xmotion.root, ev.xmotion.x, ev.xmotion.y);
 				recalculate_sweep(c, old_cx, old_cy, ev.xmotion.x, ev.xmotion.y, ev.xmotion.state & altmask);
 #ifdef INFOBANNER_MOVERESIZE
 				update_info_window(c);
 #endif
-				XSync(dpy, False);
-				XGrabServer(dpy);
-				draw_outline(c);
+				update_outline(c);
 				break;
 			case ButtonRelease:
-				draw_outline(c); /* clear */
-				XUngrabServer(dpy);
+				remove_outline();
 #ifdef INFOBANNER_MOVERESIZE
 				remove_info_window();
 #endif
-				XUngrabPointer(dpy, CurrentTime);
+				ungrab_mouse();
 				moveresize(c);
 				/* In case maximise state has changed: */
 				ewmh_set_net_wm_state(c);
@@ -193,8 +797,7 @@ void show_info(Client *c, unsigned int keycode) {
 #ifdef INFOBANNER
 	create_info_window(c);
 #else
-	XGrabServer(dpy);
-	draw_outline(c);
+	create_outline(c);
 #endif
 	do {
 		XMaskEvent(dpy, KeyReleaseMask, &ev);
@@ -210,8 +813,7 @@ void show_info(Client *c, unsigned int keycode) {
 #ifdef INFOBANNER
 	remove_info_window();
 #else
-	draw_outline(c);
-	XUngrabServer(dpy);
+	remove_outline();
 #endif
 	XChangeKeyboardControl(dpy, KBAutoRepeatMode, &(XKeyboardControl){.auto_repeat_mode = keyboard.global_auto_repeat});
 	XUngrabKeyboard(dpy, CurrentTime);
@@ -225,8 +827,7 @@ static int absmin(int a, int b) {
 
 static void snap_client(Client *c) {
 	int dx, dy;
-	int dpy_width = DisplayWidth(dpy, c->screen->screen);
-	int dpy_height = DisplayHeight(dpy, c->screen->screen);
+	Monitor *m = client_monitor(c);
 	struct list *iter;
 	Client *ci;
 
@@ -237,7 +838,7 @@ static void snap_client(Client *c) {
 		if (ci == c) continue;
 		if (ci->screen != c->screen) continue;
 #ifdef VWM
-		if (!is_fixed(ci) && ci->vdesk != c->screen->vdesk) continue;
+		if (!on_visible_vdesk(ci)) continue;
 #endif
 		if (ci->is_dock && !c->screen->docks_visible) continue;
 		if (ci->y - ci->border - c->border - c->height - c->y <= opt_snap && c->y - c->border - ci->border - ci->height - ci->y <= opt_snap) {
@@ -258,48 +859,97 @@ static void snap_client(Client *c) {
 	if (abs(dy) < opt_snap)
 		c->y += dy;
 
-	/* snap to screen border */
-	if (abs(c->x - c->border) < opt_snap) c->x = c->border;
-	if (abs(c->y - c->border) < opt_snap) c->y = c->border;
-	if (abs(c->x + c->width + c->border - dpy_width) < opt_snap)
-		c->x = dpy_width - c->width - c->border;
-	if (abs(c->y + c->height + c->border - dpy_height) < opt_snap)
-		c->y = dpy_height - c->height - c->border;
+	/* snap to the edges of the monitor's work area */
+	if (abs(c->x - c->border - m->wx) < opt_snap) c->x = m->wx + c->border;
+	if (abs(c->y - c->border - m->wy) < opt_snap) c->y = m->wy + c->border;
+	if (abs(c->x + c->width + c->border - m->wx - m->wwidth) < opt_snap)
+		c->x = m->wx + m->wwidth - c->width - c->border;
+	if (abs(c->y + c->height + c->border - m->wy - m->wheight) < opt_snap)
+		c->y = m->wy + m->wheight - c->height - c->border;
 
-	if (abs(c->x) == c->border && c->width == dpy_width)
-		c->x = 0;
-	if (abs(c->y) == c->border && c->height == dpy_height)
-		c->y = 0;
+	if (abs(c->x - m->wx) == c->border && c->width == m->wwidth)
+		c->x = m->wx;
+	if (abs(c->y - m->wy) == c->border && c->height == m->wheight)
+		c->y = m->wy;
 }
 
 void drag(Client *c) {
 	XEvent ev;
-	int x1, y1;
+	int x1, y1, dx, dy;
 	int old_cx = c->x;
 	int old_cy = c->y;
+#ifdef SOLIDDRAG
+	/* Solid drags move the frame at most once per frame_interval ms, and
+	 * send the client a ConfigureNotify at most every CONFIG_INTERVAL */
+	unsigned long frame_interval, last_move = 0, last_config = 0;
+	int move_pending = 0, config_pending = 0;
+# ifdef DEBUG
+	unsigned long start = time_ms();
+	unsigned long nmoves = 0, nconfigs = 0;
+# endif
+#endif
 
-	if (!grab_pointer(c->screen->root, MouseMask, move_curs)) return;
+	if (!grab_mouse(c->screen, move_curs)) return;
 	client_raise(c);
-	get_mouse_position(&x1, &y1, c->screen->root);
+	get_pointer_position(c->screen, &x1, &y1);
 #ifdef INFOBANNER_MOVERESIZE
 	create_info_window(c);
 #endif
 	if (no_solid_drag) {
-		XGrabServer(dpy);
-		draw_outline(c);
+		create_outline(c);
 	}
+#ifdef SOLIDDRAG
+	frame_interval = 1000 / (opt_dragrate > 0 ? opt_dragrate : refresh_rate(c->screen, x1, y1));
+	LOG_DEBUG("drag: moving at most every %lums\n", frame_interval);
+#endif
 	for (;;) {
-		XMaskEvent(dpy, MouseMask, &ev);
+#ifdef SOLIDDRAG
+		int have_event = 0;
+		if (move_pending || config_pending) {
+			/* Catch up with any deferred move or configure that is
+			 * now due, and if not all done, wait for the next one
+			 * unless more motion arrives first */
+			unsigned long now = time_ms();
+			if (move_pending && now - last_move >= frame_interval) {
+				XMoveWindow(dpy, c->parent, frame_x(c), frame_y(c));
+				move_pending = 0;
+				config_pending = 1;
+				last_move = now;
+# ifdef DEBUG
+				nmoves++;
+# endif
+			}
+			if (config_pending && now - last_config >= CONFIG_INTERVAL) {
+				send_config(c);
+				config_pending = 0;
+				last_config = now;
+# ifdef DEBUG
+				nconfigs++;
+# endif
+			}
+			if (move_pending || config_pending) {
+				if (!get_mouse_event(&ev, 0)) {
+					long wait = CONFIG_INTERVAL - (long)(now - last_config);
+					long move_wait = frame_interval - (long)(now - last_move);
+					if (move_pending && (!config_pending || move_wait < wait))
+						wait = move_wait;
+					wait_for_x(wait);
+					continue;
+				}
+				have_event = 1;
+			}
+		}
+		if (!have_event)
+#endif
+		get_mouse_event(&ev, 1);
 		switch (ev.type) {
 			case MotionNotify:
 				if (ev.xmotion.root != c->screen->root)
 					break;
-				if (no_solid_drag) {
-					draw_outline(c); /* clear */
-					XUngrabServer(dpy);
-				}
-				c->x = old_cx + (ev.xmotion.x - x1);
-				c->y = old_cy + (ev.xmotion.y - y1);
+				note_pointer_position(ev.xmotion.root, ev.xmotion.x, ev.xmotion.y);
+				mouse_offset(&ev.xmotion, x1, y1, &dx, &dy);
+				c->x = old_cx + dx;
+				c->y = old_cy + dy;
 				if (opt_snap && !(ev.xmotion.state & altmask))
 					snap_client(c);
 
@@ -307,28 +957,49 @@ void drag(Client *c) {
 				update_info_window(c);
 #endif
 				if (no_solid_drag) {
-					XSync(dpy, False);
-					XGrabServer(dpy);
-					draw_outline(c);
-				} else {
-					XMoveWindow(dpy, c->parent,
-							c->x - c->border,
-							c->y - c->border);
-					send_config(c);
+					update_outline(c);
+				}
+#ifdef SOLIDDRAG
+				else {
+					move_pending = 1;
 				}
+#endif
 				break;
 			case ButtonRelease:
 				if (no_solid_drag) {
-					draw_outline(c); /* clear */
-					XUngrabServer(dpy);
+					remove_outline();
 				}
 #ifdef INFOBANNER_MOVERESIZE
 				remove_info_window();
 #endif
-				XUngrabPointer(dpy, CurrentTime);
+				ungrab_mouse();
 				if (no_solid_drag) {
 					moveresize(c);
 				}
+#ifdef SOLIDDRAG
+				else {
+					/* Always leave the client knowing where it is */
+					if (move_pending)
+						XMoveWindow(dpy, c->parent,
+								frame_x(c), frame_y(c));
+					send_config(c);
+# ifdef DEBUG
+					{
+						unsigned long elapsed = time_ms() - start;
+						if (move_pending) nmoves++;
+						nconfigs++;
+						if (elapsed == 0) elapsed = 1;
+						LOG_DEBUG("drag: %lu moves (%lu/s), %lu configures (%lu/s) in %lums\n",
+								nmoves, nmoves * 1000 / elapsed,
+								nconfigs, nconfigs * 1000 / elapsed,
+								elapsed);
+					}
+# endif
+				}
+#endif
+#ifdef VWM
+				client_update_monitor(c);
+#endif
 				return;
 			default: break;
 		}
@@ -336,14 +1007,21 @@ void drag(Client *c) {
 }
 
 void moveresize(Client *c) {
+#ifdef VWM
+	client_update_monitor(c);
+#endif
 	client_raise(c);
-	XMoveResizeWindow(dpy, c->parent, c->x - c->border, c->y - c->border,
+	XMoveResizeWindow(dpy, c->parent, frame_x(c), frame_y(c),
 			c->width, c->height);
-	XMoveResizeWindow(dpy, c->window, 0, 0, c->width, c->height);
+	if (!is_frameless(c))
+		XMoveResizeWindow(dpy, c->window, 0, 0, c->width, c->height);
 	send_config(c);
 }
 
 void maximise_client(Client *c, int action, int hv) {
+	Monitor *m = client_monitor(c);
+	if (c->fullscreen)
+		return;
 	if (hv & MAXIMISE_HORZ) {
 		if (c->oldw) {
 			if (action == NET_WM_STATE_REMOVE
@@ -359,8 +1037,8 @@ void maximise_client(Client *c, int action, int hv) {
 				unsigned long props[2];
 				c->oldx = c->x;
 				c->oldw = c->width;
-				c->x = 0;
-				c->width = DisplayWidth(dpy, c->screen->screen);
+				c->x = m->wx;
+				c->width = m->wwidth;
 				props[0] = c->oldx;
 				props[1] = c->oldw;
 				XChangeProperty(dpy, c->window, xa_evilwm_unmaximised_horz,
@@ -384,8 +1062,8 @@ void maximise_client(Client *c, int action, int hv) {
 				unsigned long props[2];
 				c->oldy = c->y;
 				c->oldh = c->height;
-				c->y = 0;
-				c->height = DisplayHeight(dpy, c->screen->screen);
+				c->y = m->wy;
+				c->height = m->wheight;
 				props[0] = c->oldy;
 				props[1] = c->oldh;
 				XChangeProperty(dpy, c->window, xa_evilwm_unmaximised_vert,
@@ -399,32 +1077,120 @@ void maximise_client(Client *c, int action, int hv) {
 	discard_enter_events(c);
 }
 
-void next(void) {
-	struct list *newl = list_find(clients_tab_order, current);
-	Client *newc = current;
+/* Area a fullscreen client covers: its own monitor, or the span given
+ * by _NET_WM_FULLSCREEN_MONITORS */
+static void fullscreen_area(Client *c, int *x, int *y, int *w, int *h) {
+	ScreenInfo *s = c->screen;
+	Monitor *m;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		if (c->fs_monitors[i] < 0 || c->fs_monitors[i] >= s->num_monitors)
+			break;
+	}
+	if (i < 4) {
+		m = client_monitor(c);
+		*x = m->x;
+		*y = m->y;
+		*w = m->width;
+		*h = m->height;
+		return;
+	}
+	*y = s->monitors[c->fs_monitors[0]].y;
+	*h = s->monitors[c->fs_monitors[1]].y + s->monitors[c->fs_monitors[1]].height - *y;
+	*x = s->monitors[c->fs_monitors[2]].x;
+	*w = s->monitors[c->fs_monitors[3]].x + s->monitors[c->fs_monitors[3]].width - *x;
+}
+
+/* Fullscreen clients lose their border and cover the monitor, above any
+ * docks.  Unlike maximising, the previous geometry is just remembered
+ * here: nothing is kept on the window, as restarts carry it over. */
+void fullscreen_client(Client *c, int action) {
+	int fullscreen;
+
+	if (action == NET_WM_STATE_TOGGLE)
+		fullscreen = !c->fullscreen;
+	else
+		fullscreen = (action == NET_WM_STATE_ADD);
+	if (fullscreen == c->fullscreen)
+		return;
+	LOG_ENTER("fullscreen_client(window=%lx, %d)", c->window, fullscreen);
+	c->fullscreen = fullscreen;
+	if (fullscreen) {
+		c->fs_oldx = c->x;
+		c->fs_oldy = c->y;
+		c->fs_oldw = c->width;
+		c->fs_oldh = c->height;
+		c->fs_oldborder = c->border;
+		c->bypass_compositor = ewmh_get_net_wm_bypass_compositor(c);
+		fullscreen_area(c, &c->x, &c->y, &c->width, &c->height);
+		c->border = 0;
+	} else {
+		c->x = c->fs_oldx;
+		c->y = c->fs_oldy;
+		c->width = c->fs_oldw;
+		c->height = c->fs_oldh;
+		c->border = c->fs_oldborder;
+	}
+	if (!is_frameless(c))
+		XSetWindowBorderWidth(dpy, c->parent, c->border);
+	ewmh_set_net_wm_state(c);
+	moveresize(c);
+#ifdef COMPOSITE
+	composite_update_bypass(c->screen);
+#endif
+	discard_enter_events(c);
+	LOG_LEAVE();
+}
+
+/* _NET_WM_FULLSCREEN_MONITORS gives monitor indices for the top, bottom,
+ * left and right edges */
+void set_fullscreen_monitors(Client *c, const long *monitors) {
+	unsigned long prop[4];
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		c->fs_monitors[i] = monitors[i];
+		prop[i] = monitors[i];
+	}
+	XChangeProperty(dpy, c->window, xa_net_wm_fullscreen_monitors,
+			XA_CARDINAL, 32, PropModeReplace,
+			(unsigned char *)&prop, 4);
+	if (c->fullscreen) {
+		fullscreen_area(c, &c->x, &c->y, &c->width, &c->height);
+		moveresize(c);
+	}
+}
+
+/* Find the client after "from" in tab order that Alt+Tab can switch to */
+static Client *next_client(Client *from) {
+	struct list *newl = list_find(clients_tab_order, from);
+	Client *newc = from;
 	do {
 		if (newl) {
 			newl = newl->next;
-			if (!newl && !current)
-				return;
+			if (!newl && !from)
+				return NULL;
 		}
 		if (!newl)
 			newl = clients_tab_order;
 		if (!newl)
-			return;
+			return NULL;
 		newc = newl->data;
-		if (newc == current)
-			return;
+		if (newc == from)
+			return NULL;
 	}
 #ifdef VWM
 	/* NOTE: Checking against newc->screen->vdesk implies we can Alt+Tab
 	 * across screen boundaries.  Is this what we want? */
-	while ((!is_fixed(newc) && (newc->vdesk != newc->screen->vdesk)) || (newc->is_dock && !newc->screen->docks_visible));
+	while (!on_visible_vdesk(newc) || (newc->is_dock && !newc->screen->docks_visible));
 #else
 	while (0);
 #endif
-	if (!newc)
-		return;
+	return newc;
+}
+
+static void activate_client(Client *newc) {
 	client_show(newc);
 	client_raise(newc);
 	select_client(newc);
@@ -435,7 +1201,279 @@ void next(void) {
 	discard_enter_events(newc);
 }
 
+void next(void) {
+	Client *newc = next_client(current);
+	if (!newc)
+		return;
+	activate_client(newc);
+}
+
+/* With -cyclehighlight, Alt+Tab only marks each candidate in turn: its
+ * border is coloured as if active and it is framed by a few override-redirect
+ * windows, so it can be seen even when obscured.  Nothing is raised or
+ * focused, and no properties change, until highlight_commit(). */
+static Window highlight_edges[4];
+static ScreenInfo *highlight_screen = NULL;
+
+static void show_highlight(Client *c) {
+	int x = c->x - c->border - HIGHLIGHT_WIDTH;
+	int y = c->y - c->border - HIGHLIGHT_WIDTH;
+	int w = c->width + 2*(c->border + HIGHLIGHT_WIDTH);
+	int h = c->height + 2*(c->border + HIGHLIGHT_WIDTH);
+	int i;
+
+	if (highlight_screen != c->screen) {
+		XSetWindowAttributes attr;
+		if (highlight_screen) {
+			for (i = 0; i < 4; i++)
+				XDestroyWindow(dpy, highlight_edges[i]);
+		}
+		attr.override_redirect = True;
+		attr.background_pixel = c->screen->fg.pixel;
+		attr.save_under = True;
+		for (i = 0; i < 4; i++) {
+			highlight_edges[i] = XCreateWindow(dpy, c->screen->root,
+					-1, -1, 1, 1, 0,
+					CopyFromParent, InputOutput, CopyFromParent,
+					CWOverrideRedirect | CWBackPixel | CWSaveUnder, &attr);
+		}
+		highlight_screen = c->screen;
+	}
+	XMoveResizeWindow(dpy, highlight_edges[0], x, y, w, HIGHLIGHT_WIDTH);
+	XMoveResizeWindow(dpy, highlight_edges[1], x, y + h - HIGHLIGHT_WIDTH, w, HIGHLIGHT_WIDTH);
+	XMoveResizeWindow(dpy, highlight_edges[2], x, y, HIGHLIGHT_WIDTH, h);
+	XMoveResizeWindow(dpy, highlight_edges[3], x + w - HIGHLIGHT_WIDTH, y, HIGHLIGHT_WIDTH, h);
+	for (i = 0; i < 4; i++)
+		XMapRaised(dpy, highlight_edges[i]);
+}
+
+static void remove_highlight(void) {
+	int i;
+	if (!highlight_screen)
+		return;
+	for (i = 0; i < 4; i++) {
+		XDestroyWindow(dpy, highlight_edges[i]);
+		highlight_edges[i] = None;
+	}
+	highlight_screen = NULL;
+}
+
+/* Move the highlight on from "from" (NULL to start from the current
+ * client), returning the newly highlighted client */
+Client *highlight_next(Client *from) {
+	Client *newc;
+	if (!from)
+		from = current;
+	newc = next_client(from);
+	if (!newc)
+		return (from == current) ? NULL : from;
+	if (from == current) {
+		if (current)
+			client_set_border_colour(current, 0);
+	} else {
+		client_set_border_colour(from, 0);
+	}
+	client_set_border_colour(newc, 1);
+	show_highlight(newc);
+	XFlush(dpy);
+	return newc;
+}
+
+/* Finish cycling, switching to the highlighted client if there is one */
+void highlight_commit(Client *c) {
+	remove_highlight();
+	if (c) {
+		activate_client(c);
+	} else if (current) {
+		client_set_border_colour(current, 1);
+	}
+}
+
 #ifdef VWM
+/* With -containers, each virtual desktop gets a screen-sized container
+ * window, and frames are reparented into the one for their desktop.
+ * Switching desktop is then one map and one unmap, however many windows
+ * are involved, and windows all appear together.  Fixed clients are moved
+ * into whichever container is showing.
+ *
+ * A container covers the whole screen, so desktop windows can't go
+ * beneath it: they would be hidden.  Instead they live at the bottom of
+ * the visible container, and move along with fixed clients.  They aren't
+ * managed, so they're found as whatever children of a container aren't
+ * frames. */
+
+void vdesk_containers_init(ScreenInfo *s) {
+	XSetWindowAttributes attr;
+	struct list *iter;
+	unsigned int v;
+
+	for (v = 0; v <= VDESK_MAX; v++)
+		s->vdesk_container[v] = None;
+	/* Containers span the screen, so can't show a desktop per monitor */
+	if (!opt_containers || opt_monitordesks)
+		return;
+	/* Containers sit at the bottom of the stack.  They select no pointer
+	 * events, and propagate them all, so clicks on empty space reach
+	 * whoever selected them on the root (and our own root grabs look
+	 * through them to the frame under the pointer). */
+	attr.override_redirect = True;
+	attr.background_pixmap = ParentRelative;
+	attr.event_mask = ChildMask;
+	attr.do_not_propagate_mask = NoEventMask;
+	for (v = 0; v <= VDESK_MAX; v++) {
+		s->vdesk_container[v] = XCreateWindow(dpy, s->root, 0, 0,
+				DisplayWidth(dpy, s->screen), DisplayHeight(dpy, s->screen), 0,
+				CopyFromParent, InputOutput, CopyFromParent,
+				CWOverrideRedirect | CWBackPixmap | CWEventMask
+				| CWDontPropagate, &attr);
+		XLowerWindow(dpy, s->vdesk_container[v]);
+	}
+	XMapWindow(dpy, s->vdesk_container[s->vdesk]);
+
+	/* Clients adopted after a restart come in with frames on the root,
+	 * unmapped if they were hidden */
+	for (iter = clients_stacking_order; iter; iter = iter->next) {
+		Client *c = iter->data;
+		int shown;
+		if (c->screen != s)
+			continue;
+		shown = (is_fixed(c) || c->vdesk == s->vdesk) && !dock_hidden(c);
+		client_to_container(c, shown || c->parked);
+		if (!dock_hidden(c))
+			client_map_frame(c);
+	}
+}
+
+/* Reparent a desktop window, keeping its position (containers are at the
+ * origin of the root), to the bottom of the new parent's stack */
+static void move_desktop_window(Window w, Window parent) {
+	Window root;
+	int x, y;
+	unsigned int width, height, bw, depth;
+
+	if (!XGetGeometry(dpy, w, &root, &x, &y, &width, &height, &bw, &depth))
+		return;
+	XReparentWindow(dpy, w, parent, x, y);
+	XLowerWindow(dpy, w);
+}
+
+/* Move every desktop window in one container to another (or the root),
+ * keeping their order */
+static void move_desktop_windows(Window from, Window to) {
+	Window dw1, dw2, *wins;
+	unsigned int nwins, i;
+
+	if (!XQueryTree(dpy, from, &dw1, &dw2, &wins, &nwins))
+		return;
+	/* Top first, each lowered beneath the last */
+	for (i = nwins; i > 0; i--) {
+		if (!find_client(wins[i-1]))
+			move_desktop_window(wins[i-1], to);
+	}
+	if (wins)
+		XFree(wins);
+}
+
+void desktop_to_container(ScreenInfo *s, Window w) {
+	move_desktop_window(w, s->vdesk_container[s->vdesk]);
+}
+
+/* Frames go back on the root, hidden ones unmapped, as if containers had
+ * never been used: a restarted process may not want them */
+void vdesk_containers_deinit(ScreenInfo *s) {
+	struct list *iter;
+	unsigned int v;
+
+	if (!has_vdesk_containers(s))
+		return;
+	for (iter = clients_stacking_order; iter; iter = iter->next) {
+		Client *c = iter->data;
+		if (c->screen != s || c->container == s->root)
+			continue;
+		if (!is_fixed(c) && c->vdesk != s->vdesk && !dock_hidden(c))
+			XUnmapWindow(dpy, c->parent);
+		XReparentWindow(dpy, c->parent, s->root, frame_x(c), frame_y(c));
+		c->container = s->root;
+	}
+	/* Destroying the container would take desktop windows with it */
+	move_desktop_windows(s->vdesk_container[s->vdesk], s->root);
+	for (v = 0; v <= VDESK_MAX; v++) {
+		XDestroyWindow(dpy, s->vdesk_container[v]);
+		s->vdesk_container[v] = None;
+	}
+}
+
+void vdesk_containers_resize(ScreenInfo *s) {
+	unsigned int v;
+	if (!has_vdesk_containers(s))
+		return;
+	for (v = 0; v <= VDESK_MAX; v++) {
+		XResizeWindow(dpy, s->vdesk_container[v],
+				DisplayWidth(dpy, s->screen), DisplayHeight(dpy, s->screen));
+	}
+}
+
+/* Move a client's frame into the container it belongs in, if it's not
+ * already there.  If the frame is mapped, reparenting unmaps it, and that
+ * unmap has to be ignored. */
+void client_to_container(Client *c, int mapped) {
+	ScreenInfo *s = c->screen;
+	Window container;
+
+	if (!has_vdesk_containers(s))
+		return;
+	if (is_fixed(c) || c->vdesk > VDESK_MAX)
+		container = s->vdesk_container[s->vdesk];
+	else
+		container = s->vdesk_container[c->vdesk];
+	if (container == c->container)
+		return;
+	if (mapped)
+		c->ignore_unmap++;
+	XReparentWindow(dpy, c->parent, container, frame_x(c), frame_y(c));
+	c->container = container;
+}
+
+static void switch_vdesk_containers(ScreenInfo *s, unsigned int v) {
+	Window old_container = s->vdesk_container[s->vdesk];
+	struct list *iter, *fixed = NULL;
+
+	s->old_vdesk = s->vdesk;
+	s->vdesk = v;
+
+	/* Fixed clients come along, ending up above this desktop's windows
+	 * in the same order as before */
+	for (iter = clients_stacking_order; iter; iter = iter->next) {
+		Client *c = iter->data;
+		if (c->screen == s && is_fixed(c)) {
+			client_to_container(c, !dock_hidden(c) || c->parked);
+			fixed = list_append(fixed, c);
+		}
+	}
+	while (fixed) {
+		clients_stacking_order = list_to_tail(clients_stacking_order, fixed->data);
+		fixed = list_delete(fixed, fixed->data);
+	}
+
+	move_desktop_windows(old_container, s->vdesk_container[v]);
+	XMapWindow(dpy, s->vdesk_container[v]);
+	XUnmapWindow(dpy, old_container);
+
+	/* Window states are only updated once the switch is done */
+	XFlush(dpy);
+	for (iter = clients_tab_order; iter; iter = iter->next) {
+		Client *c = iter->data;
+		if (c->screen != s || is_fixed(c) || dock_hidden(c))
+			continue;
+		if (c->vdesk == s->old_vdesk)
+			client_set_hidden(c, 1);
+		else if (c->vdesk == v)
+			client_set_hidden(c, 0);
+	}
+	ewmh_set_net_current_desktop(s);
+	ewmh_set_net_client_list_stacking(s);
+}
+
 void switch_vdesk(ScreenInfo *s, unsigned int v) {
 	struct list *iter;
 #ifdef DEBUG
@@ -448,10 +1486,18 @@ void switch_vdesk(ScreenInfo *s, unsigned int v) {
 	if (current && !is_fixed(current)) {
 		select_client(NULL);
 	}
+	if (has_vdesk_containers(s)) {
+		switch_vdesk_containers(s, v);
+		LOG_LEAVE();
+		return;
+	}
 	for (iter = clients_tab_order; iter; iter = iter->next) {
 		Client *c = iter->data;
 		if (c->screen != s)
 			continue;
+		/* With -monitordesks, only the current monitor switches */
+		if (opt_monitordesks && c->monitor != s->current_monitor)
+			continue;
 		if (c->vdesk == s->vdesk) {
 			client_hide(c);
 #ifdef DEBUG
@@ -468,6 +1514,8 @@ void switch_vdesk(ScreenInfo *s, unsigned int v) {
 	/* cache the value of the current vdesk, so that user may toggle back to it */
 	s->old_vdesk = s->vdesk;
 	s->vdesk = v;
+	s->monitors[s->current_monitor].old_vdesk = s->old_vdesk;
+	s->monitors[s->current_monitor].vdesk = v;
 	ewmh_set_net_current_desktop(s);
 	LOG_DEBUG("%d hidden, %d raised\n", hidden, raised);
 	LOG_LEAVE();
@@ -486,11 +1534,13 @@ void set_docks_visible(ScreenInfo *s, int is_visible) {
 		if (c->is_dock) {
 			if (is_visible) {
 #ifdef VWM
-				if (is_fixed(c) || (c->vdesk == s->vdesk)) {
+				if (on_visible_vdesk(c)) {
 #endif
 					client_show(c);
 					client_raise(c);
 #ifdef VWM
+				} else if (has_vdesk_containers(s)) {
+					client_map_frame(c);
 				}
 #endif
 			} else {
@@ -501,6 +1551,382 @@ void set_docks_visible(ScreenInfo *s, int is_visible) {
 	LOG_LEAVE();
 }
 
+/* Monitor layout is fetched when a screen is set up and whenever RandR
+ * reports a change; everything else looks it up from this table.  RandR
+ * 1.5 monitors are preferred, then Xinerama (which only describes a
+ * single X screen), then the whole screen as one monitor. */
+void update_monitors(ScreenInfo *s) {
+	int n = 0;
+
+	s->last_monitor = 0;
+#ifdef RANDR
+	if (have_randr_monitors) {
+		XRRMonitorInfo *info = XRRGetMonitors(dpy, s->root, True, &n);
+		int i;
+		if (!info)
+			n = 0;
+		if (n > MAX_MONITORS)
+			n = MAX_MONITORS;
+		for (i = 0; i < n; i++) {
+			s->monitors[i].x = info[i].x;
+			s->monitors[i].y = info[i].y;
+			s->monitors[i].width = info[i].width;
+			s->monitors[i].height = info[i].height;
+		}
+		if (info)
+			XRRFreeMonitors(info);
+	}
+#endif
+#ifdef XINERAMA
+	if (n <= 0 && have_xinerama && num_screens == 1) {
+		XineramaScreenInfo *info = XineramaQueryScreens(dpy, &n);
+		int i;
+		if (!info)
+			n = 0;
+		if (n > MAX_MONITORS)
+			n = MAX_MONITORS;
+		for (i = 0; i < n; i++) {
+			s->monitors[i].x = info[i].x_org;
+			s->monitors[i].y = info[i].y_org;
+			s->monitors[i].width = info[i].width;
+			s->monitors[i].height = info[i].height;
+		}
+		if (info)
+			XFree(info);
+	}
+#endif
+	if (n <= 0) {
+		n = 1;
+		s->monitors[0].x = 0;
+		s->monitors[0].y = 0;
+		s->monitors[0].width = DisplayWidth(dpy, s->screen);
+		s->monitors[0].height = DisplayHeight(dpy, s->screen);
+	}
+#ifdef VWM
+	/* New monitors start on the desktop currently in use */
+	for (; s->num_monitors < n; s->num_monitors++) {
+		s->monitors[s->num_monitors].vdesk = s->vdesk;
+		s->monitors[s->num_monitors].old_vdesk = s->old_vdesk;
+	}
+	if (s->current_monitor >= n)
+		set_current_monitor(s, 0);
+#endif
+	s->num_monitors = n;
+	LOG_DEBUG("screen %d: %d monitor(s)\n", s->screen, n);
+	for (n = 0; n < s->num_monitors; n++) {
+		Monitor *m = &s->monitors[n];
+		m->wx = m->x;
+		m->wy = m->y;
+		m->wwidth = m->width;
+		m->wheight = m->height;
+		m->refresh = 0;
+	}
+	update_workarea(s);
+}
+
+/* Does the span start..end (inclusive) overlap pos..pos+len-1? */
+static int spans(int start, int end, int pos, int len) {
+	return start < pos + len && end >= pos;
+}
+
+/* Work out each monitor's work area from the struts of the visible
+ * clients that have them.  Only those few clients are looked at, and only
+ * when one of them changes or is shown or hidden: everything else reads
+ * the cached result. */
+void update_workarea(ScreenInfo *s) {
+	int sw = DisplayWidth(dpy, s->screen);
+	int sh = DisplayHeight(dpy, s->screen);
+	int i, changed = 0;
+
+	for (i = 0; i < s->num_monitors; i++) {
+		Monitor *m = &s->monitors[i];
+		int x1 = m->x, y1 = m->y;
+		int x2 = m->x + m->width, y2 = m->y + m->height;
+		struct list *iter;
+		for (iter = s->struts; iter; iter = iter->next) {
+			Client *c = iter->data;
+			const int *st = c->strut;
+			if (c->hidden)
+				continue;
+			if (st[0] > m->x && spans(st[4], st[5], m->y, m->height)
+					&& st[0] > x1)
+				x1 = st[0];
+			if (sw - st[1] < m->x + m->width && spans(st[6], st[7], m->y, m->height)
+					&& sw - st[1] < x2)
+				x2 = sw - st[1];
+			if (st[2] > m->y && spans(st[8], st[9], m->x, m->width)
+					&& st[2] > y1)
+				y1 = st[2];
+			if (sh - st[3] < m->y + m->height && spans(st[10], st[11], m->x, m->width)
+					&& sh - st[3] < y2)
+				y2 = sh - st[3];
+		}
+		/* Struts that would leave nothing are ignored */
+		if (x2 <= x1) {
+			x1 = m->x;
+			x2 = m->x + m->width;
+		}
+		if (y2 <= y1) {
+			y1 = m->y;
+			y2 = m->y + m->height;
+		}
+		if (x1 != m->wx || y1 != m->wy
+				|| x2 - x1 != m->wwidth || y2 - y1 != m->wheight) {
+			m->wx = x1;
+			m->wy = y1;
+			m->wwidth = x2 - x1;
+			m->wheight = y2 - y1;
+			changed = 1;
+		}
+	}
+	if (changed) {
+		LOG_DEBUG("screen %d: work area changed\n", s->screen);
+		ewmh_set_net_workarea(s);
+	}
+}
+
+/* Re-read a client's struts, updating the work area if they changed */
+void client_update_strut(Client *c) {
+	ScreenInfo *s = c->screen;
+	int strut[12];
+	int had = has_strut(c);
+
+	if (!ewmh_get_net_wm_strut(c, strut) && !had)
+		return;
+	if (0 == memcmp(strut, c->strut, sizeof(strut)))
+		return;
+	memcpy(c->strut, strut, sizeof(strut));
+	if (!had)
+		s->struts = list_prepend(s->struts, c);
+	else if (!has_strut(c))
+		s->struts = list_delete(s->struts, c);
+	update_workarea(s);
+}
+
+static int monitor_contains(Monitor *m, int x, int y) {
+	return x >= m->x && x < m->x + m->width
+		&& y >= m->y && y < m->y + m->height;
+}
+
+/* Monitor containing (x,y), or the nearest one if it's off all of them.
+ * Lookups tend to repeat, so the last answer is tried first. */
+Monitor *find_monitor(ScreenInfo *s, int x, int y) {
+	int i, best = 0;
+	long best_dist = -1;
+
+	if (monitor_contains(&s->monitors[s->last_monitor], x, y))
+		return &s->monitors[s->last_monitor];
+	for (i = 0; i < s->num_monitors; i++) {
+		Monitor *m = &s->monitors[i];
+		long dx = 0, dy = 0, dist;
+		if (x < m->x) dx = m->x - x;
+		else if (x >= m->x + m->width) dx = x - (m->x + m->width - 1);
+		if (y < m->y) dy = m->y - y;
+		else if (y >= m->y + m->height) dy = y - (m->y + m->height - 1);
+		dist = dx * dx + dy * dy;
+		if (best_dist < 0 || dist < best_dist) {
+			best = i;
+			best_dist = dist;
+			if (dist == 0)
+				break;
+		}
+	}
+	s->last_monitor = best;
+	return &s->monitors[best];
+}
+
+/* Monitor showing most of a rectangle, or nearest its centre if it's on
+ * none of them */
+Monitor *find_monitor_rect(ScreenInfo *s, int x, int y, int w, int h) {
+	Monitor *m = find_monitor(s, x + w / 2, y + h / 2);
+	long area = 0;
+	int i;
+
+	if (s->num_monitors == 1)
+		return m;
+	for (i = 0; i < s->num_monitors; i++) {
+		Monitor *mi = &s->monitors[i];
+		int x1 = x > mi->x ? x : mi->x;
+		int y1 = y > mi->y ? y : mi->y;
+		int x2 = (x + w < mi->x + mi->width) ? x + w : mi->x + mi->width;
+		int y2 = (y + h < mi->y + mi->height) ? y + h : mi->y + mi->height;
+		long a = (x2 > x1 && y2 > y1) ? (long)(x2 - x1) * (y2 - y1) : 0;
+		if (a > area) {
+			area = a;
+			m = mi;
+		}
+	}
+	return m;
+}
+
+Monitor *client_monitor(Client *c) {
+	return find_monitor_rect(c->screen, c->x - c->border, c->y - c->border,
+			c->width + 2*c->border, c->height + 2*c->border);
+}
+
+#ifdef VWM
+/* With -monitordesks, each monitor shows its own virtual desktop and
+ * clients belong to the monitor they're (mostly) on.  The screen's vdesk
+ * and old_vdesk follow whichever monitor has focus, so most code (and
+ * _NET_CURRENT_DESKTOP) needn't care. */
+
+/* Called when a client may have moved to another monitor.  If it was
+ * visible, it joins the desktop showing there. */
+void client_update_monitor(Client *c) {
+	ScreenInfo *s = c->screen;
+	int i = client_monitor(c) - s->monitors;
+	int was_visible = on_visible_vdesk(c);
+
+	if (i == c->monitor)
+		return;
+	c->monitor = i;
+	if (opt_monitordesks && was_visible && !on_visible_vdesk(c)) {
+		c->vdesk = s->monitors[i].vdesk;
+		ewmh_set_net_wm_desktop(c);
+	}
+}
+
+void set_current_monitor(ScreenInfo *s, int i) {
+	if (!opt_monitordesks || i == s->current_monitor)
+		return;
+	s->current_monitor = i;
+	s->old_vdesk = s->monitors[i].old_vdesk;
+	if (s->vdesk != s->monitors[i].vdesk) {
+		s->vdesk = s->monitors[i].vdesk;
+		ewmh_set_net_current_desktop(s);
+	}
+}
+#endif
+
+/* Move a span (position p, size len) from one monitor's range to the
+ * same relative place in another, keeping it within the new one as far as
+ * possible */
+static int relayout_span(int p, int len, int bw, int old_start, int new_start, int new_len) {
+	p += new_start - old_start;
+	if (p + len + bw > new_start + new_len)
+		p = new_start + new_len - len - bw;
+	if (p - bw < new_start)
+		p = new_start + bw;
+	return p;
+}
+
+/* After the monitor layout changes, move every client on the screen to
+ * the corresponding monitor (the one with the same index, if there still
+ * is one) and refit maximised clients and their saved geometry.  All the
+ * moves go out in one batch with no round trips. */
+void relayout_screen(ScreenInfo *s, const Monitor *old, int num_old) {
+	struct list *iter;
+#ifdef DEBUG
+	unsigned long start = time_ms();
+	int nclients = 0, nmoved = 0;
+#endif
+
+	LOG_ENTER("relayout_screen(screen=%d, %d -> %d monitors)", s->screen, num_old, s->num_monitors);
+	for (iter = clients_tab_order; iter; iter = iter->next) {
+		Client *c = iter->data;
+		const Monitor *om;
+		Monitor *nm;
+		int i, best = 0;
+		long area = -1;
+		int ox = c->x, oy = c->y, ow = c->width, oh = c->height;
+
+		if (c->screen != s)
+			continue;
+#ifdef DEBUG
+		nclients++;
+#endif
+		/* Old monitor: the one that showed most of the client */
+		for (i = 0; i < num_old; i++) {
+			int x1 = c->x > old[i].x ? c->x : old[i].x;
+			int y1 = c->y > old[i].y ? c->y : old[i].y;
+			int x2 = (c->x + c->width < old[i].x + old[i].width) ? c->x + c->width : old[i].x + old[i].width;
+			int y2 = (c->y + c->height < old[i].y + old[i].height) ? c->y + c->height : old[i].y + old[i].height;
+			long a = (x2 > x1 && y2 > y1) ? (long)(x2 - x1) * (y2 - y1) : 0;
+			if (a > area) {
+				area = a;
+				best = i;
+			}
+		}
+		om = &old[best];
+		if (best < s->num_monitors)
+			nm = &s->monitors[best];
+		else
+			nm = find_monitor(s, om->x + om->width / 2, om->y + om->height / 2);
+
+		if (c->fullscreen) {
+			/* Saved geometry moves with it, like a maximised client's */
+			c->fs_oldx = relayout_span(c->fs_oldx, c->fs_oldw, c->fs_oldborder, om->x, nm->x, nm->width);
+			c->fs_oldy = relayout_span(c->fs_oldy, c->fs_oldh, c->fs_oldborder, om->y, nm->y, nm->height);
+		}
+		if (c->oldw) {
+			c->x = nm->wx;
+			c->width = nm->wwidth;
+			c->oldx = relayout_span(c->oldx, c->oldw, c->border, om->x, nm->x, nm->width);
+		} else {
+			c->x = relayout_span(c->x, c->width, c->border, om->x, nm->x, nm->width);
+		}
+		if (c->oldh) {
+			c->y = nm->wy;
+			c->height = nm->wheight;
+			c->oldy = relayout_span(c->oldy, c->oldh, c->border, om->y, nm->y, nm->height);
+		} else {
+			c->y = relayout_span(c->y, c->height, c->border, om->y, nm->y, nm->height);
+		}
+		if (c->oldw || c->oldh) {
+			unsigned long props[2];
+			if (c->oldw) {
+				props[0] = c->oldx;
+				props[1] = c->oldw;
+				XChangeProperty(dpy, c->window, xa_evilwm_unmaximised_horz,
+						XA_CARDINAL, 32, PropModeReplace,
+						(unsigned char *)&props, 2);
+			}
+			if (c->oldh) {
+				props[0] = c->oldy;
+				props[1] = c->oldh;
+				XChangeProperty(dpy, c->window, xa_evilwm_unmaximised_vert,
+						XA_CARDINAL, 32, PropModeReplace,
+						(unsigned char *)&props, 2);
+			}
+		}
+#ifdef VWM
+		if (opt_monitordesks) {
+			int was_visible = on_visible_vdesk(c);
+			c->monitor = nm - s->monitors;
+			if (was_visible && !on_visible_vdesk(c)) {
+				c->vdesk = nm->vdesk;
+				ewmh_set_net_wm_desktop(c);
+			} else if (!was_visible && on_visible_vdesk(c) && !dock_hidden(c)) {
+				client_show(c);
+			}
+		} else {
+			c->monitor = nm - s->monitors;
+		}
+#endif
+		if (c->fullscreen) {
+			c->x = nm->x;
+			c->y = nm->y;
+			c->width = nm->width;
+			c->height = nm->height;
+			fullscreen_area(c, &c->x, &c->y, &c->width, &c->height);
+		}
+		if (c->x == ox && c->y == oy && c->width == ow && c->height == oh)
+			continue;
+		XMoveResizeWindow(dpy, c->parent, frame_x(c), frame_y(c),
+				c->width, c->height);
+		if (!is_frameless(c))
+			XMoveResizeWindow(dpy, c->window, 0, 0, c->width, c->height);
+		send_config(c);
+#ifdef DEBUG
+		nmoved++;
+#endif
+	}
+	ewmh_set_screen_geometry(s);
+	XFlush(dpy);
+	LOG_DEBUG("%d of %d clients moved in %lums\n", nmoved, nclients, time_ms() - start);
+	LOG_LEAVE();
+}
+
 ScreenInfo *find_screen(Window root) {
 	int i;
 	for (i = 0; i < num_screens; i++) {
@@ -510,14 +1936,59 @@ ScreenInfo *find_screen(Window root) {
 	return NULL;
 }
 
-ScreenInfo *find_current_screen(void) {
+/* The screen the pointer is on and its last known position are tracked
+ * from the root coordinates carried by key, button, motion and crossing
+ * events.  XQueryPointer is only used when this cache is stale.  The
+ * screen stays valid until a LeaveNotify on a root says otherwise, but
+ * as motion isn't tracked, the position only holds while handling the
+ * event it came from (or during a move or resize, which sees every
+ * motion event). */
+static ScreenInfo *pointer_screen = NULL;
+static int pointer_known = 0;
+static int pointer_x, pointer_y;
+
+static void query_pointer(void) {
 	Window cur_root, dw;
-	int di;
+	int x, y, di;
 	unsigned int dui;
 
 	/* XQueryPointer is useful for getting the current pointer root */
-	XQueryPointer(dpy, screens[0].root, &cur_root, &dw, &di, &di, &di, &di, &dui);
-	return find_screen(cur_root);
+	XQueryPointer(dpy, screens[0].root, &cur_root, &dw, &x, &y, &di, &di, &dui);
+	note_pointer_position(cur_root, x, y);
+}
+
+void note_pointer_position(Window root, int x, int y) {
+	ScreenInfo *s = find_screen(root);
+	if (!s)
+		return;
+	pointer_screen = s;
+	pointer_known = 1;
+	pointer_x = x;
+	pointer_y = y;
+}
+
+/* Pointer has been warped: still on the same screen, but position unknown */
+void forget_pointer_position(void) {
+	pointer_known = 0;
+}
+
+/* Pointer has left for another screen */
+void forget_pointer_screen(void) {
+	pointer_screen = NULL;
+	pointer_known = 0;
+}
+
+ScreenInfo *find_current_screen(void) {
+	if (!pointer_screen)
+		query_pointer();
+	return pointer_screen;
+}
+
+void get_pointer_position(ScreenInfo *s, int *x, int *y) {
+	if (!pointer_known || pointer_screen != s)
+		query_pointer();
+	*x = pointer_x;
+	*y = pointer_y;
 }
 
 static void grab_keysym(Window w, unsigned int mask, KeySym keysym) {
@@ -565,3 +2036,39 @@ void grab_keys_for_screen(ScreenInfo *s) {
 	}
 	grab_keysym(s->root, grabmask2, KEY_NEXT);
 }
+
+/* Button grabs are either made on every frame, or (with -rootgrabs) once
+ * on each root window, the client then being found from the subwindow the
+ * event reports.  Root grabs freeze the pointer, so that a click that
+ * isn't on a client can be replayed to whoever it was meant for. */
+void grab_frame_buttons(Window frame) {
+	if (opt_rootgrabs)
+		return;
+	grab_button(frame, grabmask2, AnyButton);
+	grab_button(frame, grabmask2 | altmask, AnyButton);
+}
+
+void grab_buttons_for_screen(ScreenInfo *s) {
+	XUngrabButton(dpy, AnyButton, AnyModifier, s->root);
+	if (!opt_rootgrabs)
+		return;
+	grab_button_mode(s->root, grabmask2, AnyButton, GrabModeSync);
+	grab_button_mode(s->root, grabmask2 | altmask, AnyButton, GrabModeSync);
+}
+
+/* Redo every button grab, after the modifiers involved have changed */
+void regrab_buttons(void) {
+	struct list *iter;
+	int i;
+	for (i = 0; i < num_screens; i++) {
+		grab_buttons_for_screen(&screens[i]);
+		/* spare frames have the old grabs */
+		frame_pool_deinit(&screens[i]);
+		frame_pool_init(&screens[i]);
+	}
+	for (iter = clients_tab_order; iter; iter = iter->next) {
+		Client *c = iter->data;
+		XUngrabButton(dpy, AnyButton, AnyModifier, c->parent);
+		grab_frame_buttons(c->parent);
+	}
+}